@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include <tree/node/definitions.hpp>
+#include <tree/node/direction.hpp>
+#include <tree/node/cell.hpp>
+#include <tree/node/family.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Batch versions of the znode operations (plus, minus, level, hash,
+/// unhash and father) working on contiguous arrays of znode values.
+///
+/// For 64 bits values, the kernels use AVX-512 or AVX2 if enabled at
+/// compile time (e.g. -mavx2, -march=native), the remaining elements
+/// being processed by the scalar ZNode methods. The results are bit
+/// identical to the scalar versions (voidbit included).
+///
+/// \brief vectorized znode kernels.
+////////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX2__)
+//! AVX2 kernels on 4 values.
+template<std::size_t dim, typename zvalue_type>
+struct batch_avx2
+{
+    using definition = definitions<dim, zvalue_type>;
+    static constexpr std::size_t width = 4;
+
+    static inline __m256i set1(zvalue_type v)
+    {
+        return _mm256_set1_epi64x(static_cast<long long>(v));
+    }
+
+    static inline __m256i level(__m256i v)
+    {
+        return _mm256_srli_epi64(v, definition::levelshift);
+    }
+
+    static inline __m256i times_dim(__m256i lev)
+    {
+        return (dim == 1) ? lev
+             : (dim == 2) ? _mm256_slli_epi64(lev, 1)
+             : _mm256_add_epi64(lev, _mm256_slli_epi64(lev, 1));
+    }
+
+    //! equivalent to AllOnes[lev]
+    static inline __m256i allones(__m256i lev)
+    {
+        const __m256i shift = _mm256_sub_epi64(set1(dim*(definition::nlevels-1)), times_dim(lev));
+        return _mm256_sllv_epi64(_mm256_srlv_epi64(set1(definition::maskpos), shift), shift);
+    }
+
+    template<bool is_plus>
+    static inline __m256i move(__m256i v, zvalue_type dbit, zvalue_type mask, std::size_t stencil)
+    {
+        const __m256i lev = level(v);
+        const __m256i maskv = set1(mask);
+        const __m256i tmp = set1(definition::maskpos - mask);
+        const __m256i bit = _mm256_srlv_epi64(set1(dbit), times_dim(lev));
+        const __m256i keep = _mm256_add_epi64(_mm256_and_si256(v, tmp),
+                                              _mm256_and_si256(v, set1(definition::levelzone)));
+        __m256i dec = _mm256_setzero_si256();
+        for (std::size_t i = 0; i < stencil; ++i)
+            dec = _mm256_add_epi64(_mm256_or_si256(dec, tmp), bit);
+
+        const __m256i vmask = _mm256_and_si256(v, maskv);
+        const __m256i mv = is_plus ? _mm256_add_epi64(vmask, _mm256_or_si256(dec, tmp))
+                                   : _mm256_sub_epi64(vmask, _mm256_and_si256(dec, maskv));
+        const __m256i t = _mm256_or_si256(_mm256_and_si256(v, set1(definition::voidbit)),
+                                          _mm256_andnot_si256(set1(definition::maskpos), mv));
+        const __m256i is_void = _mm256_andnot_si256(_mm256_cmpeq_epi64(t, _mm256_setzero_si256()),
+                                                    set1(definition::voidbit));
+        const __m256i pos = _mm256_and_si256(_mm256_and_si256(mv, maskv), allones(lev));
+        return _mm256_add_epi64(_mm256_add_epi64(pos, keep), is_void);
+    }
+
+    static inline __m256i hash(__m256i v, bool is_hash)
+    {
+        const __m256i lev = level(v);
+        const __m256i shift = times_dim(_mm256_add_epi64(lev, set1(1)));
+        const __m256i h = _mm256_srlv_epi64(set1(definition::XYZbit), shift);
+        return is_hash ? _mm256_add_epi64(v, h) : _mm256_sub_epi64(v, h);
+    }
+
+    static inline __m256i father(__m256i v)
+    {
+        const __m256i lev = _mm256_sub_epi64(level(v), set1(1));
+        return _mm256_add_epi64(_mm256_and_si256(v, allones(lev)),
+                                _mm256_slli_epi64(lev, definition::levelshift));
+    }
+
+    static inline __m256i load(zvalue_type const* p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+    }
+
+    static inline void store(zvalue_type* p, __m256i v)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+    }
+};
+#endif
+
+#if defined(__AVX512F__)
+//! AVX-512 kernels on 8 values.
+template<std::size_t dim, typename zvalue_type>
+struct batch_avx512
+{
+    using definition = definitions<dim, zvalue_type>;
+    static constexpr std::size_t width = 8;
+
+    static inline __m512i set1(zvalue_type v)
+    {
+        return _mm512_set1_epi64(static_cast<long long>(v));
+    }
+
+    static inline __m512i level(__m512i v)
+    {
+        return _mm512_srli_epi64(v, definition::levelshift);
+    }
+
+    static inline __m512i times_dim(__m512i lev)
+    {
+        return (dim == 1) ? lev
+             : (dim == 2) ? _mm512_slli_epi64(lev, 1)
+             : _mm512_add_epi64(lev, _mm512_slli_epi64(lev, 1));
+    }
+
+    //! equivalent to AllOnes[lev]
+    static inline __m512i allones(__m512i lev)
+    {
+        const __m512i shift = _mm512_sub_epi64(set1(dim*(definition::nlevels-1)), times_dim(lev));
+        return _mm512_sllv_epi64(_mm512_srlv_epi64(set1(definition::maskpos), shift), shift);
+    }
+
+    template<bool is_plus>
+    static inline __m512i move(__m512i v, zvalue_type dbit, zvalue_type mask, std::size_t stencil)
+    {
+        const __m512i lev = level(v);
+        const __m512i maskv = set1(mask);
+        const __m512i tmp = set1(definition::maskpos - mask);
+        const __m512i bit = _mm512_srlv_epi64(set1(dbit), times_dim(lev));
+        const __m512i keep = _mm512_add_epi64(_mm512_and_si512(v, tmp),
+                                              _mm512_and_si512(v, set1(definition::levelzone)));
+        __m512i dec = _mm512_setzero_si512();
+        for (std::size_t i = 0; i < stencil; ++i)
+            dec = _mm512_add_epi64(_mm512_or_si512(dec, tmp), bit);
+
+        const __m512i vmask = _mm512_and_si512(v, maskv);
+        const __m512i mv = is_plus ? _mm512_add_epi64(vmask, _mm512_or_si512(dec, tmp))
+                                   : _mm512_sub_epi64(vmask, _mm512_and_si512(dec, maskv));
+        const __m512i t = _mm512_or_si512(_mm512_and_si512(v, set1(definition::voidbit)),
+                                          _mm512_andnot_si512(set1(definition::maskpos), mv));
+        const __m512i is_void = _mm512_maskz_mov_epi64(_mm512_test_epi64_mask(t, t), set1(definition::voidbit));
+        const __m512i pos = _mm512_and_si512(_mm512_and_si512(mv, maskv), allones(lev));
+        return _mm512_add_epi64(_mm512_add_epi64(pos, keep), is_void);
+    }
+
+    static inline __m512i hash(__m512i v, bool is_hash)
+    {
+        const __m512i lev = level(v);
+        const __m512i shift = times_dim(_mm512_add_epi64(lev, set1(1)));
+        const __m512i h = _mm512_srlv_epi64(set1(definition::XYZbit), shift);
+        return is_hash ? _mm512_add_epi64(v, h) : _mm512_sub_epi64(v, h);
+    }
+
+    static inline __m512i father(__m512i v)
+    {
+        const __m512i lev = _mm512_sub_epi64(level(v), set1(1));
+        return _mm512_add_epi64(_mm512_and_si512(v, allones(lev)),
+                                _mm512_slli_epi64(lev, definition::levelshift));
+    }
+
+    static inline __m512i load(zvalue_type const* p)
+    {
+        return _mm512_loadu_si512(p);
+    }
+
+    static inline void store(zvalue_type* p, __m512i v)
+    {
+        _mm512_storeu_si512(p, v);
+    }
+};
+#endif
+
+//! vector kernels selected at compile time (void if none is available).
+template<std::size_t dim, typename zvalue_type, typename = void>
+struct batch_kernel
+{
+    using type = void;
+};
+
+template<std::size_t dim, typename zvalue_type>
+struct batch_kernel<dim, zvalue_type, std::enable_if_t<sizeof(zvalue_type) == 8>>
+{
+#if defined(__AVX512F__)
+    using type = batch_avx512<dim, zvalue_type>;
+#elif defined(__AVX2__)
+    using type = batch_avx2<dim, zvalue_type>;
+#else
+    using type = void;
+#endif
+};
+
+//! apply a vector functor on the largest multiple of the kernel width
+//! and return the number of processed elements.
+//! \note f is called with an instance of the kernel and a vector of values.
+template<typename kernel, typename zvalue_type, typename output_type, typename function_type>
+inline std::size_t batch_apply(zvalue_type const* input, output_type* output, std::size_t size,
+                               function_type&& f, std::false_type)
+{
+    std::size_t i = 0;
+    for (; i + kernel::width <= size; i += kernel::width)
+        kernel::store(reinterpret_cast<zvalue_type*>(output + i), f(kernel{}, kernel::load(input + i)));
+    return i;
+}
+
+//! no vector kernel available: nothing is processed.
+template<typename kernel, typename zvalue_type, typename output_type, typename function_type>
+inline std::size_t batch_apply(zvalue_type const*, output_type*, std::size_t,
+                               function_type&&, std::true_type)
+{
+    return 0;
+}
+
+template<typename kernel, typename zvalue_type, typename output_type, typename function_type>
+inline std::size_t batch_apply(zvalue_type const* input, output_type* output, std::size_t size,
+                               function_type&& f)
+{
+    return batch_apply<kernel>(input, output, size, std::forward<function_type>(f), std::is_void<kernel>{});
+}
+
+//! shift by stencil in direction d all the znodes of input.
+//! \param input the znode values (size elements).
+//! \param output the moved znode values (size elements, can be input).
+//! \param size number of elements.
+//! \param d the direction.
+//! \param stencil the shift.
+template<std::size_t dim, typename zvalue_type>
+void plus(zvalue_type const* input, zvalue_type* output, std::size_t size,
+          direction d, std::size_t stencil=1)
+{
+    using cell_type = Cell<dim, zvalue_type>;
+    using kernel = typename batch_kernel<dim, zvalue_type>::type;
+
+    if (stencil == 0)
+    {
+        std::copy(input, input + size, output);
+        return;
+    }
+
+    const auto dec = cell_type{}._get_dec(d);
+    const zvalue_type dbit = dec.first;
+    const zvalue_type mask = dec.second;
+    std::size_t i = batch_apply<kernel>(input, output, size, [&](auto k, auto v)
+    {
+        return decltype(k)::template move<true>(v, dbit, mask, stencil);
+    });
+    for (; i < size; ++i)
+        output[i] = cell_type{input[i]}.plus(d, stencil);
+}
+
+//! shift by -stencil in direction d all the znodes of input.
+//! \param input the znode values (size elements).
+//! \param output the moved znode values (size elements, can be input).
+//! \param size number of elements.
+//! \param d the direction.
+//! \param stencil the shift.
+template<std::size_t dim, typename zvalue_type>
+void minus(zvalue_type const* input, zvalue_type* output, std::size_t size,
+           direction d, std::size_t stencil=1)
+{
+    using cell_type = Cell<dim, zvalue_type>;
+    using kernel = typename batch_kernel<dim, zvalue_type>::type;
+
+    const auto dec = cell_type{}._get_dec(d);
+    const zvalue_type dbit = dec.first;
+    const zvalue_type mask = dec.second;
+    std::size_t i = batch_apply<kernel>(input, output, size, [&](auto k, auto v)
+    {
+        return decltype(k)::template move<false>(v, dbit, mask, stencil);
+    });
+    for (; i < size; ++i)
+        output[i] = cell_type{input[i]}.minus(d, stencil);
+}
+
+//! compute the level of all the znodes of input.
+template<std::size_t dim, typename zvalue_type>
+void level(zvalue_type const* input, std::size_t* output, std::size_t size)
+{
+    using cell_type = Cell<dim, zvalue_type>;
+    using kernel = std::conditional_t<sizeof(std::size_t) == sizeof(zvalue_type),
+                                      typename batch_kernel<dim, zvalue_type>::type, void>;
+
+    std::size_t i = batch_apply<kernel>(input, output, size, [](auto k, auto v){ return decltype(k)::level(v); });
+    for (; i < size; ++i)
+        output[i] = cell_type{input[i]}.level();
+}
+
+//! compute the hash code of all the znodes of input.
+template<std::size_t dim, typename zvalue_type>
+void hash(zvalue_type const* input, zvalue_type* output, std::size_t size)
+{
+    using cell_type = Cell<dim, zvalue_type>;
+    using kernel = typename batch_kernel<dim, zvalue_type>::type;
+
+    std::size_t i = batch_apply<kernel>(input, output, size, [](auto k, auto v){ return decltype(k)::hash(v, true); });
+    for (; i < size; ++i)
+        output[i] = cell_type{input[i]}.hash();
+}
+
+//! compute the non hashed representation of all the znodes of input.
+template<std::size_t dim, typename zvalue_type>
+void unhash(zvalue_type const* input, zvalue_type* output, std::size_t size)
+{
+    using cell_type = Cell<dim, zvalue_type>;
+    using kernel = typename batch_kernel<dim, zvalue_type>::type;
+
+    std::size_t i = batch_apply<kernel>(input, output, size, [](auto k, auto v){ return decltype(k)::hash(v, false); });
+    for (; i < size; ++i)
+        output[i] = cell_type{input[i]}.unhash();
+}
+
+//! compute the father of all the znodes of input.
+//! \note the znodes must have a level greater than 0.
+template<std::size_t dim, typename zvalue_type>
+void father(zvalue_type const* input, zvalue_type* output, std::size_t size)
+{
+    using cell_type = Cell<dim, zvalue_type>;
+    using kernel = typename batch_kernel<dim, zvalue_type>::type;
+
+    std::size_t i = batch_apply<kernel>(input, output, size, [](auto k, auto v){ return decltype(k)::father(v); });
+    for (; i < size; ++i)
+        output[i] = father(cell_type{input[i]});
+}
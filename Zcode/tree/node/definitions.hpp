@@ -4,6 +4,9 @@
 #include <tree/node/util.hpp>
 #include <tree/node/zcurve.hpp>
 
+//! constants of the znodes of dimension Dim stored in value_type.
+//! \note value_type can be any unsigned integer type, including
+//! unsigned __int128 for deep trees (3d: 39 levels instead of 18).
 template <std::size_t Dim, typename value_type=std::size_t>
 struct definitions
 {
@@ -22,7 +25,7 @@ struct definitions
     //how many nodes at level 0?
     static const int nlevZero = 1<<dim;
     static const value_type one = 1;
-    static const value_type allone = static_cast<std::size_t>(~0);
+    static const value_type allone = static_cast<value_type>(~value_type{0});
 
     // first free bit:
     static const value_type firstfreebit = one<<(dim*nlevels);
@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include <tree/node/definitions.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Dilated integers: spread the bits of a coordinate so that they land
+/// in one lane of a znode position (XMask, YMask or ZMask).
+///
+/// On BMI2 hardware this is a single pdep/pext instruction, elsewhere
+/// we use the classical magic-bits sequences.
+///
+/// \brief bit deposit/extract of coordinates in znode lanes.
+////////////////////////////////////////////////////////////////////////
+
+//! spread the bits of x: bit i goes to bit dim*i (magic-bits version).
+//! \note only the bits fitting in 64 digits are kept.
+inline std::uint64_t spread_bits(std::uint64_t x, std::integral_constant<std::size_t, 1>)
+{
+    return x;
+}
+
+inline std::uint64_t spread_bits(std::uint64_t x, std::integral_constant<std::size_t, 2>)
+{
+    x &= 0x00000000ffffffffull;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x <<  8)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x <<  4)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x <<  2)) & 0x3333333333333333ull;
+    x = (x | (x <<  1)) & 0x5555555555555555ull;
+    return x;
+}
+
+inline std::uint64_t spread_bits(std::uint64_t x, std::integral_constant<std::size_t, 3>)
+{
+    x &= 0x00000000001fffffull;
+    x = (x | (x << 32)) & 0x001f00000000ffffull;
+    x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+    x = (x | (x <<  8)) & 0x100f00f00f00f00full;
+    x = (x | (x <<  4)) & 0x10c30c30c30c30c3ull;
+    x = (x | (x <<  2)) & 0x1249249249249249ull;
+    return x;
+}
+
+//! inverse of spread_bits: bit dim*i goes to bit i.
+inline std::uint64_t compact_bits(std::uint64_t x, std::integral_constant<std::size_t, 1>)
+{
+    return x;
+}
+
+inline std::uint64_t compact_bits(std::uint64_t x, std::integral_constant<std::size_t, 2>)
+{
+    x &= 0x5555555555555555ull;
+    x = (x | (x >>  1)) & 0x3333333333333333ull;
+    x = (x | (x >>  2)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x >>  4)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x >>  8)) & 0x0000ffff0000ffffull;
+    x = (x | (x >> 16)) & 0x00000000ffffffffull;
+    return x;
+}
+
+inline std::uint64_t compact_bits(std::uint64_t x, std::integral_constant<std::size_t, 3>)
+{
+    x &= 0x1249249249249249ull;
+    x = (x | (x >>  2)) & 0x10c30c30c30c30c3ull;
+    x = (x | (x >>  4)) & 0x100f00f00f00f00full;
+    x = (x | (x >>  8)) & 0x001f0000ff0000ffull;
+    x = (x | (x >> 16)) & 0x001f00000000ffffull;
+    x = (x | (x >> 32)) & 0x00000000001fffffull;
+    return x;
+}
+
+//! Put the digits of the coordinate x in the lane d of a znode position
+//! (compile-time version).
+//! \param x the coordinate (at the finest level).
+//! \param d the lane (0: x, 1: y, 2: z).
+template<std::size_t dim, typename value_type>
+constexpr value_type dilate_constexpr(value_type x, std::size_t d)
+{
+    using definition = definitions<dim, value_type>;
+    value_type output = 0;
+    for (std::size_t i = 0; i < static_cast<std::size_t>(definition::nlevels); ++i)
+        output |= static_cast<value_type>((x >> i)&1) << (dim*i + dim-1-d);
+    return output;
+}
+
+//! number of coordinate digits handled by one 64 bits word.
+template<std::size_t dim>
+constexpr std::size_t dilate_chunk()
+{
+    return 64/dim;
+}
+
+//! Put the digits of the coordinate x in the lane d of a znode position.
+//! \param x the coordinate (at the finest level).
+//! \param d the lane (0: x, 1: y, 2: z).
+//! \note the result is masked by XMask>>d.
+template<std::size_t dim, typename value_type>
+inline value_type dilate(value_type x, std::size_t d)
+{
+    using definition = definitions<dim, value_type>;
+    const value_type mask = definition::XMask >> d;
+#if defined(__BMI2__)
+    if (sizeof(value_type) <= sizeof(std::uint64_t))
+        return static_cast<value_type>(_pdep_u64(static_cast<std::uint64_t>(x), static_cast<std::uint64_t>(mask)));
+#endif
+    constexpr std::size_t chunk = dilate_chunk<dim>();
+    constexpr std::size_t nchunks = (sizeof(value_type)*8 + dim*chunk - 1)/(dim*chunk);
+    value_type output = 0;
+    for (std::size_t c = 0; c < nchunks; ++c)
+    {
+        std::uint64_t part = static_cast<std::uint64_t>(x >> (c*chunk));
+        output |= static_cast<value_type>(spread_bits(part, std::integral_constant<std::size_t, dim>{})) << (c*chunk*dim);
+    }
+    return (output << (dim-1-d)) & mask;
+}
+
+//! Extract the coordinate stored in the lane d of a znode position.
+//! \param v the znode position (at the finest level).
+//! \param d the lane (0: x, 1: y, 2: z).
+template<std::size_t dim, typename value_type>
+inline value_type undilate(value_type v, std::size_t d)
+{
+    using definition = definitions<dim, value_type>;
+    const value_type mask = definition::XMask >> d;
+#if defined(__BMI2__)
+    if (sizeof(value_type) <= sizeof(std::uint64_t))
+        return static_cast<value_type>(_pext_u64(static_cast<std::uint64_t>(v), static_cast<std::uint64_t>(mask)));
+#endif
+    constexpr std::size_t chunk = dilate_chunk<dim>();
+    constexpr std::size_t nchunks = (sizeof(value_type)*8 + dim*chunk - 1)/(dim*chunk);
+    value_type lane = (v & mask) >> (dim-1-d);
+    value_type output = 0;
+    for (std::size_t c = 0; c < nchunks; ++c)
+    {
+        std::uint64_t part = static_cast<std::uint64_t>(lane >> (c*chunk*dim));
+        output |= static_cast<value_type>(compact_bits(part, std::integral_constant<std::size_t, dim>{})) << (c*chunk);
+    }
+    return output;
+}
@@ -3,6 +3,7 @@
 #include <tree/node/definitions.hpp>
 #include <tree/node/cell.hpp>
 #include <tree/node/neighbor.hpp>
+#include <tree/node/ordering.hpp>
 
 //! return the son of a Node which has the smallest absissa (ie, the 1rst
 //! one in the son's brotherhood.
@@ -39,7 +40,7 @@ inline auto father(node_type const& node)
     using zvalue_type = typename node_type::zvalue_type;
     using definition = definitions<node_type::dim, zvalue_type>;
     auto level = node.level() - 1;
-    return static_cast<zvalue_type>((node.value&definition::AllOnes[level])+(level<<definition::levelshift));
+    return static_cast<zvalue_type>((node.value&definition::AllOnes[level])+(static_cast<zvalue_type>(level)<<definition::levelshift));
 }
 
 //! test if a Node A is an ancestor of a Node X.
@@ -113,20 +114,51 @@ void brothers_impl(node_type const& node,
     neighbors(node, brothers, stencil);
 }
 
+//! brothers in Z order: the stencil of the dimension.
+template<typename node_type, typename Node_array>
+void brothers_impl(node_type const& node, Node_array & brothers, ZOrder)
+{
+    brothers_impl(node, brothers, std::integral_constant<std::size_t, node_type::dim>{});
+}
+
+//! brothers in an other order than Z: the curve orientation is given by
+//! the ancestors of the node.
+template<typename node_type, typename Node_array, typename TOrder>
+void brothers_impl(node_type const& node, Node_array & brothers, TOrder)
+{
+    using zvalue_type = typename node_type::zvalue_type;
+    using definition = definitions<node_type::dim, zvalue_type>;
+    constexpr std::size_t dim = node_type::dim;
+
+    const std::size_t level = node.level();
+    const std::size_t shift = dim*(definition::nlevels-1-level);
+    const zvalue_type digit = static_cast<zvalue_type>(definition::treetype-1) << shift;
+    const zvalue_type first = (node.value&(definition::AllOnes[level]-digit))
+                            + (node.value&(definition::levelzone|definition::voidbit));
+    const std::size_t state = TOrder::template state<dim>(node.value, level);
+    for(std::size_t i=0; i < definition::treetype; ++i)
+        brothers[i] = first + (static_cast<zvalue_type>(TOrder::template child<dim>(state, i)) << shift);
+}
+
 //! Make the list of the brothers of a minimal node in a brothers set.
+//! \param TOrder the order of the curve (ZOrder or HilbertOrder).
 //! \param node the node for which we build the list.
 //! \param Brothers the list of brothers.
-//! \note node *must* be minimal in his brothers set. *NOT TESTED*, except
-//! if DEBUG is set.
-//! \note Brothers[0] == node.
-//! \note the output array Brothers is ordered. 
-template<typename Node_type, typename Node_array>
+//! \note with ZOrder, node *must* be minimal in his brothers set. *NOT
+//! TESTED*, except if DEBUG is set. With another order, any brother can
+//! be given.
+//! \note Brothers[0] == node with ZOrder. With another order, Brothers[0]
+//! is the first brother along the curve.
+//! \note with ZOrder, Brothers is in the order of the stencil (by value
+//! in 1d and 2d, not in 3d: sort them if needed). With another order, it
+//! is along the curve.
+template<typename TOrder = ZOrder, typename Node_type, typename Node_array>
 void brothers(Node_type const& node, Node_array & Brothers)
 {
 #ifdef DEBUG
     if(!node.is_minimal())
       throw GenericException("brothers",node,"not minimal");
 #endif
-    brothers_impl(node, Brothers, std::integral_constant<std::size_t, Node_type::dim>{});
+    brothers_impl(node, Brothers, TOrder{});
 }
 
@@ -4,6 +4,7 @@
 #include <tree/node/direction.hpp>
 #include <tree/node/cell.hpp>
 #include <tree/node/util.hpp>
+#include <tree/node/stencil.hpp>
 
 #include <type_traits>
 
@@ -29,19 +30,17 @@ void neighbors(node_type const& node,
 {
     static_assert(std::is_same<zvalue_type, typename node_type::zvalue_type>::value,
                   "The element type of the output array is not the same as node_type.");
-    using cell_type = Cell<node_type::dim, zvalue_type>;
     using definition = definitions<node_type::dim, zvalue_type>;
 
     std::size_t index = 0;
     for(auto &sy: stencily)
     {
-        cell_type node_y = (sy<0)?node.minus(direction::y, -sy): node.plus(direction::y, sy);
         for(auto &sx: stencilx)
         {
             if (sx==0 && sy==0)
                 node_array[index++] = node.value|definition::voidbit;
             else
-                node_array[index++] = (sx<0)? node_y.minus(direction::x, -sx): node_y.plus(direction::x, sx);
+                node_array[index++] = node.plus({{sx, sy}});
         }
     }
 }
@@ -54,13 +53,9 @@ void neighbors(node_type const& node,
     static_assert(std::is_same<zvalue_type, typename node_type::zvalue_type>::value,
                   "The element type of the output array is not the same as node_type.");
 
-    using cell_type = Cell<node_type::dim, zvalue_type>;
     std::size_t index = 0;
     for(auto &s: stencil)
-    {
-        cell_type node_x = (s[0]<0)?node.minus(direction::x, -s[0]): node.plus(direction::x, s[0]);
-        node_array[index++] = (s[1]<0)? node_x.minus(direction::y, -s[1]): node_x.plus(direction::y, s[1]);
-    }
+        node_array[index++] = node.plus(s);
 }
 
 template<typename node_type, std::size_t ns, typename zvalue_type>
@@ -70,14 +65,9 @@ void neighbors(node_type const& node,
 {
     static_assert(std::is_same<zvalue_type, typename node_type::zvalue_type>::value,
                   "The element type of the output array is not the same as node_type.");
-    using cell_type = Cell<node_type::dim, zvalue_type>;
     std::size_t index = 0;
     for(auto &s: stencil)
-    {
-        cell_type node_x = (s[0]<0)?node.minus(direction::x, -s[0]): node.plus(direction::x, s[0]);
-        cell_type node_y = (s[1]<0)?node_x.minus(direction::y, -s[1]): node_x.plus(direction::y, s[1]);
-        node_array[index++] = (s[2]<0)? node_y.minus(direction::z, -s[2]): node_y.plus(direction::z, s[2]);
-    }
+        node_array[index++] = node.plus(s);
 }
 
 template<typename node_type, std::size_t nx, std::size_t ny, std::size_t nz, typename zvalue_type>
@@ -89,19 +79,133 @@ void neighbors(node_type const& node,
 {
     static_assert(std::is_same<zvalue_type, typename node_type::zvalue_type>::value,
                   "The element type of the output array is not the same as node_type.");
-    using cell_type = Cell<node_type::dim, zvalue_type>;
     std::size_t index = 0;
     for(auto &sz: stencilz)
-    {
-        cell_type node_z = (sz<0)?node.minus(direction::z, -sz): node.plus(direction::z, sz);
         for(auto &sy: stencily)
-        {
-            cell_type node_y = (sy<0)?node_z.minus(direction::y, -sy): node_z.plus(direction::y, sy);
             for(auto &sx: stencilx)
-            {
-                node_array[index++] = (sx<0)? node_y.minus(direction::x, -sx): node_y.plus(direction::x, sx);
-            }
+                node_array[index++] = node.plus({{sx, sy, sz}});
+}
+
+//////////////////////////////////////////////////////
+//
+// COMPILE-TIME STENCILS
+//
+//////////////////////////////////////////////////////
+//! largest absolute value of the offsets of a stencil.
+template<typename TStencil>
+constexpr int stencil_radius()
+{
+    int radius = 0;
+    for (std::size_t i = 0; i < TStencil::size; ++i)
+        for (std::size_t d = 0; d < TStencil::dim; ++d)
+        {
+            int o = TStencil::offset(i, d);
+            radius = (o > radius) ? o: (-o > radius) ? -o: radius;
         }
+    return radius;
+}
+
+//! tables of a stencil computed at compile time:
+//!  - index[i][d]: offset i in the direction d, shifted by the radius,
+//!  - center[i]: true if the offset i is zero,
+//!  - dilated[d][k]: k dilated in the lane d (finest level).
+template<typename TStencil, typename zvalue_type>
+struct stencil_table
+{
+    static constexpr std::size_t dim = TStencil::dim;
+    static constexpr std::size_t size = TStencil::size;
+    static constexpr int radius = stencil_radius<TStencil>();
+    static constexpr std::size_t width = 2*radius + 1;
+
+    using index_type = std::array<std::uint8_t, dim>;
+    using dilated_type = std::array<zvalue_type, radius + 1>;
+
+    static_assert(width <= 256, "The stencil radius is too large.");
+
+    template<std::size_t... d>
+    static constexpr index_type make_index(std::size_t i, std::index_sequence<d...>)
+    {
+        return {{static_cast<std::uint8_t>(TStencil::offset(i, d) + radius)...}};
+    }
+
+    template<std::size_t... i>
+    static constexpr std::array<index_type, size> make_index(std::index_sequence<i...>)
+    {
+        return {{make_index(i, std::make_index_sequence<dim>{})...}};
+    }
+
+    static constexpr bool is_center(std::size_t i)
+    {
+        for (std::size_t d = 0; d < dim; ++d)
+            if (TStencil::offset(i, d) != 0)
+                return false;
+        return true;
+    }
+
+    template<std::size_t... i>
+    static constexpr std::array<bool, size> make_center(std::index_sequence<i...>)
+    {
+        return {{is_center(i)...}};
+    }
+
+    template<std::size_t... k>
+    static constexpr dilated_type make_dilated(std::size_t d, std::index_sequence<k...>)
+    {
+        return {{dilate_constexpr<dim>(static_cast<zvalue_type>(k), d)...}};
+    }
+
+    template<std::size_t... d>
+    static constexpr std::array<dilated_type, dim> make_dilated(std::index_sequence<d...>)
+    {
+        return {{make_dilated(d, std::make_index_sequence<radius + 1>{})...}};
+    }
+
+    static constexpr std::array<index_type, size> index = make_index(std::make_index_sequence<size>{});
+    static constexpr std::array<bool, size> center = make_center(std::make_index_sequence<size>{});
+    static constexpr std::array<dilated_type, dim> dilated = make_dilated(std::make_index_sequence<dim>{});
+};
+
+template<typename TStencil, typename zvalue_type>
+constexpr std::array<typename stencil_table<TStencil, zvalue_type>::index_type, stencil_table<TStencil, zvalue_type>::size> stencil_table<TStencil, zvalue_type>::index;
+
+template<typename TStencil, typename zvalue_type>
+constexpr std::array<bool, stencil_table<TStencil, zvalue_type>::size> stencil_table<TStencil, zvalue_type>::center;
+
+template<typename TStencil, typename zvalue_type>
+constexpr std::array<typename stencil_table<TStencil, zvalue_type>::dilated_type, stencil_table<TStencil, zvalue_type>::dim> stencil_table<TStencil, zvalue_type>::dilated;
+
+//! compute the neighbors of a node given by a stencil shape known at
+//! compile time (see stencil.hpp).
+//! \param node the node.
+//! \param node_array the neighbors, in the order of the stencil offsets.
+//! \note the offset tables are built at compile time, and each lane is
+//! moved only once per offset value: the neighbors are then obtained by
+//! combining the lanes.
+template<typename TStencil, typename node_type, typename zvalue_type>
+void neighbors(node_type const& node,
+               std::array<zvalue_type, TStencil::size> &node_array)
+{
+    static_assert(std::is_same<zvalue_type, typename node_type::zvalue_type>::value,
+                  "The element type of the output array is not the same as node_type.");
+    static_assert(TStencil::dim == node_type::dim,
+                  "The stencil dimension is not the same as node_type.");
+    using table = stencil_table<TStencil, zvalue_type>;
+    using definition = definitions<node_type::dim, zvalue_type>;
+    constexpr int radius = table::radius;
+
+    // each lane is moved once for each offset value.
+    std::array<std::array<zvalue_type, table::width>, node_type::dim> lanes;
+    for (std::size_t d = 0; d < node_type::dim; ++d)
+        for (int o = -radius; o <= radius; ++o)
+            lanes[d][o + radius] = node._moveLane(d, o, table::dilated[d][(o < 0) ? -o: o]);
+
+    const zvalue_type common = node.value&(definition::levelzone|definition::voidbit);
+    for (std::size_t i = 0; i < TStencil::size; ++i)
+    {
+        zvalue_type neighbor = common;
+        for (std::size_t d = 0; d < node_type::dim; ++d)
+            neighbor |= lanes[d][table::index[i][d]];
+        node_array[i] = table::center[i] ? node.value: neighbor;
     }
 }
 
@@ -110,15 +214,14 @@ void neighbors(node_type const& node,
 // BOX
 //
 //////////////////////////////////////////////////////
-template<std::size_t stencil, std::size_t array_size, typename node_type, typename zvalue_type>
+template<std::size_t stencil, std::size_t array_size, typename node_type, typename zvalue_type, std::size_t dim>
 void boxNeighbors_impl(node_type const& node, 
                        std::array<zvalue_type, array_size> &neighbors_array, 
-                       std::integral_constant<std::size_t, 1>)
+                       std::integral_constant<std::size_t, dim>)
 {
     static_assert(array_size == ipow(2*stencil+1, node_type::dim),
                   "The array size is not good.");
-    std::array<int, 2*stencil+1> const s{Stencil_array<stencil>()};
-    neighbors(node, neighbors_array, s);
+    neighbors<BoxStencil<dim, stencil>>(node, neighbors_array);
 }
 
 template<std::size_t stencil, std::size_t array_size, typename node_type, typename zvalue_type>
@@ -128,19 +231,10 @@ void boxNeighbors_impl(node_type const& node,
 {
     static_assert(array_size == ipow(2*stencil+1, node_type::dim),
                   "The array size is not good.");
-    std::array<int, 2*stencil+1> const s{Stencil_array<stencil>()};
-    neighbors(node, neighbors_array, s, s);
-}
-
-template<std::size_t stencil, std::size_t array_size, typename node_type, typename zvalue_type>
-void boxNeighbors_impl(node_type const& node,
-                       std::array<zvalue_type, array_size> &neighbors_array, 
-                       std::integral_constant<std::size_t, 3>)
-{
-    static_assert(array_size == ipow(2*stencil+1, node_type::dim),
-                  "The array size is not good.");
-    std::array<int, 2*stencil+1> const s{Stencil_array<stencil>()};
-    neighbors(node, neighbors_array, s, s, s);
+    using definition = definitions<node_type::dim, zvalue_type>;
+    neighbors<BoxStencil<2, stencil>>(node, neighbors_array);
+    // as neighbors(node, array, stencilx, stencily), the center is void.
+    neighbors_array[array_size/2] |= definition::voidbit;
 }
 
 //! find a potential neighbor, depending on the position of u.
@@ -157,58 +251,14 @@ void boxNeighbors(node_type const& node, neighbors_type &neighbors_array)
 // STAR
 //
 //////////////////////////////////////////////////////
-template<int stencil, std::size_t array_size, typename node_type, typename zvalue_type>
-void starNeighbors_impl(node_type const& node,
-                        std::array<zvalue_type, array_size> &neighbors_array, 
-                        std::integral_constant<std::size_t, 1>)
-{
-    static_assert(array_size == 2*stencil*node_type::dim,
-                  "The array size is not good.");
-    std::array<int, 2*stencil> s;
-    std::size_t index = 0;
-    for (int i=-stencil; i<=stencil; ++i)
-        if (i!=0)
-        {
-            s[index++] = i;
-        }
-    neighbors(node, neighbors_array, s);
-}
-
-template<int stencil, std::size_t array_size, typename node_type, typename zvalue_type>
-void starNeighbors_impl(node_type const& node,
-                        std::array<zvalue_type, array_size> &neighbors_array, 
-                        std::integral_constant<std::size_t, 2>)
-{
-    static_assert(array_size == 2*stencil*node_type::dim,
-                  "The array size is not good.");    
-    std::array<std::array<int, 2>, 4*stencil> s;
-    std::size_t index = 0;
-    for (int i=-stencil; i<=stencil; ++i)
-        if (i!=0)
-        {
-            s[index] = {i, 0};
-            s[2*stencil + index++] = {0, i};
-        }
-    neighbors(node, neighbors_array, s);
-}
-
-template<int stencil, std::size_t array_size, typename node_type, typename zvalue_type>
+template<int stencil, std::size_t array_size, typename node_type, typename zvalue_type, std::size_t dim>
 void starNeighbors_impl(node_type const& node,
                         std::array<zvalue_type, array_size> &neighbors_array, 
-                        std::integral_constant<std::size_t, 3>)
+                        std::integral_constant<std::size_t, dim>)
 {
     static_assert(array_size == 2*stencil*node_type::dim,
                   "The array size is not good.");
-    std::array<std::array<int, 3>, 6*stencil> s;
-    std::size_t index = 0;
-    for (int i=-stencil; i<=stencil; ++i)
-        if (i!=0)
-        {
-            s[index] = {i, 0, 0};
-            s[2*stencil + index] = {0, i, 0};
-            s[4*stencil + index++] = {0, 0, i};
-        }
-    neighbors(node, neighbors_array, s);
+    neighbors<StarStencil<dim, stencil>>(node, neighbors_array);
 }
 
 //! find a potential neighbor, depending on the position of u.
@@ -0,0 +1,258 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#include <tree/node/definitions.hpp>
+#include <tree/node/zcurve.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Ordering policies of the cells.
+///
+/// The znodes always store their position as a Morton (Z) code: the
+/// ordering policy only defines the order in which the cells are
+/// visited. A policy provides:
+///  - key<dim>(value): the order key of a znode value. The position part
+///    is replaced by the index along the curve, the level and the free
+///    bits are kept,
+///  - value<dim>(key): the inverse mapping,
+///  - state<dim>(value, ndigits): the orientation of the curve after
+///    the ndigits first digits of the position,
+///  - child<dim>(state, rank): the Morton digit of the rank-th child
+///    visited in the given orientation.
+///
+/// Use it like:
+///
+///  refine<HilbertOrder>(cell, children);
+///  std::sort(cells.begin(), cells.end(), [](auto a, auto b){return less<HilbertOrder>(a, b);});
+///
+/// \brief Z and Hilbert orders of the cells.
+////////////////////////////////////////////////////////////////////////
+
+//! Morton digit of the rank-th child in the Z order.
+//! \note same order as definitions::TailGen.
+template<std::size_t dim>
+constexpr std::size_t zorder_child(std::size_t rank)
+{
+    return zcurve<dim>(std::size_t{1} << (dim-1), (std::size_t{1} << (dim-1)) >> 1, (std::size_t{1} << (dim-1)) >> 2)[rank];
+}
+
+//! Z (Morton) order: the key is the znode value itself.
+struct ZOrder
+{
+    template<std::size_t dim, typename zvalue_type>
+    static inline zvalue_type key(zvalue_type value)
+    {
+        return value;
+    }
+
+    template<std::size_t dim, typename zvalue_type>
+    static inline zvalue_type value(zvalue_type key)
+    {
+        return key;
+    }
+
+    template<std::size_t dim, typename zvalue_type>
+    static inline std::size_t state(zvalue_type, std::size_t)
+    {
+        return 0;
+    }
+
+    template<std::size_t dim>
+    static constexpr std::size_t child(std::size_t, std::size_t rank)
+    {
+        return zorder_child<dim>(rank);
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////
+// Hilbert curve state machine (see C. Hamilton, "Compact Hilbert
+// indices", 2006). The orientation of a sub-cube is given by its entry
+// point e and its intra direction d: state = e*dim + d.
+/////////////////////////////////////////////////////////////////////////
+
+constexpr std::size_t hilbert_rotr(std::size_t x, std::size_t k, std::size_t n)
+{
+    return ((x >> (k%n)) | (x << (n - k%n))) & ((std::size_t{1} << n) - 1);
+}
+
+constexpr std::size_t hilbert_rotl(std::size_t x, std::size_t k, std::size_t n)
+{
+    return ((x << (k%n)) | (x >> (n - k%n))) & ((std::size_t{1} << n) - 1);
+}
+
+constexpr std::size_t hilbert_gray(std::size_t i)
+{
+    return i ^ (i >> 1);
+}
+
+constexpr std::size_t hilbert_gray_inverse(std::size_t g, std::size_t n)
+{
+    std::size_t i = g;
+    for (std::size_t j = 1; j < n; ++j)
+        i ^= g >> j;
+    return i;
+}
+
+constexpr std::size_t hilbert_trailing_ones(std::size_t i)
+{
+    std::size_t n = 0;
+    while (i&1)
+    {
+        i >>= 1;
+        ++n;
+    }
+    return n;
+}
+
+//! entry point of the w-th sub-cube.
+constexpr std::size_t hilbert_entry(std::size_t w)
+{
+    return (w == 0) ? 0: hilbert_gray(2*((w-1)/2));
+}
+
+//! intra direction of the w-th sub-cube.
+constexpr std::size_t hilbert_direction(std::size_t w, std::size_t n)
+{
+    return (w == 0) ? 0
+         : (w&1) ? hilbert_trailing_ones(w)%n
+         : hilbert_trailing_ones(w-1)%n;
+}
+
+//! tables of the Hilbert curve, indexed by state*treetype + digit:
+//!  - rank: rank along the curve of the Morton digit,
+//!  - child: Morton digit of the rank-th sub-cube,
+//!  - next: state of the sub-cube of Morton digit.
+template<std::size_t dim>
+struct hilbert_table
+{
+    static constexpr std::size_t treetype = std::size_t{1} << dim;
+    static constexpr std::size_t nstates = treetype*dim;
+    using table_type = std::array<std::uint8_t, nstates*treetype>;
+
+    static constexpr std::size_t rank_of(std::size_t s, std::size_t l)
+    {
+        return hilbert_gray_inverse(hilbert_rotr(l ^ (s/dim), s%dim + 1, dim), dim);
+    }
+
+    static constexpr std::size_t child_of(std::size_t s, std::size_t w)
+    {
+        return hilbert_rotl(hilbert_gray(w), s%dim + 1, dim) ^ (s/dim);
+    }
+
+    static constexpr std::size_t next_of(std::size_t s, std::size_t l)
+    {
+        return (s/dim ^ hilbert_rotl(hilbert_entry(rank_of(s, l)), s%dim + 1, dim))*dim
+             + (s%dim + hilbert_direction(rank_of(s, l), dim) + 1)%dim;
+    }
+
+    template<std::size_t... i>
+    static constexpr table_type make_rank(std::index_sequence<i...>)
+    {
+        return {{static_cast<std::uint8_t>(rank_of(i/treetype, i%treetype))...}};
+    }
+
+    template<std::size_t... i>
+    static constexpr table_type make_child(std::index_sequence<i...>)
+    {
+        return {{static_cast<std::uint8_t>(child_of(i/treetype, i%treetype))...}};
+    }
+
+    template<std::size_t... i>
+    static constexpr table_type make_next(std::index_sequence<i...>)
+    {
+        return {{static_cast<std::uint8_t>(next_of(i/treetype, i%treetype))...}};
+    }
+
+    static constexpr table_type rank = make_rank(std::make_index_sequence<nstates*treetype>{});
+    static constexpr table_type child = make_child(std::make_index_sequence<nstates*treetype>{});
+    static constexpr table_type next = make_next(std::make_index_sequence<nstates*treetype>{});
+};
+
+template<std::size_t dim>
+constexpr typename hilbert_table<dim>::table_type hilbert_table<dim>::rank;
+
+template<std::size_t dim>
+constexpr typename hilbert_table<dim>::table_type hilbert_table<dim>::child;
+
+template<std::size_t dim>
+constexpr typename hilbert_table<dim>::table_type hilbert_table<dim>::next;
+
+//! Hilbert order: the key is the index along the Hilbert curve.
+//! \note the key of a cell is a prefix of the keys of its descendants,
+//! so that the keys can be compared like Morton codes.
+struct HilbertOrder
+{
+    template<std::size_t dim, typename zvalue_type>
+    static inline zvalue_type key(zvalue_type value)
+    {
+        using definition = definitions<dim, zvalue_type>;
+        using table = hilbert_table<dim>;
+        const std::size_t level = value >> definition::levelshift;
+
+        zvalue_type key = value&(~definition::maskpos);
+        std::size_t s = 0;
+        for (std::size_t i = 0; i <= level; ++i)
+        {
+            const std::size_t shift = dim*(definition::nlevels-1-i);
+            const std::size_t l = static_cast<std::size_t>(value >> shift)&(table::treetype-1);
+            key |= static_cast<zvalue_type>(table::rank[s*table::treetype + l]) << shift;
+            s = table::next[s*table::treetype + l];
+        }
+        return key;
+    }
+
+    template<std::size_t dim, typename zvalue_type>
+    static inline zvalue_type value(zvalue_type key)
+    {
+        using definition = definitions<dim, zvalue_type>;
+        using table = hilbert_table<dim>;
+        const std::size_t level = key >> definition::levelshift;
+
+        zvalue_type value = key&(~definition::maskpos);
+        std::size_t s = 0;
+        for (std::size_t i = 0; i <= level; ++i)
+        {
+            const std::size_t shift = dim*(definition::nlevels-1-i);
+            const std::size_t w = static_cast<std::size_t>(key >> shift)&(table::treetype-1);
+            const std::size_t l = table::child[s*table::treetype + w];
+            value |= static_cast<zvalue_type>(l) << shift;
+            s = table::next[s*table::treetype + l];
+        }
+        return value;
+    }
+
+    template<std::size_t dim, typename zvalue_type>
+    static inline std::size_t state(zvalue_type value, std::size_t ndigits)
+    {
+        using definition = definitions<dim, zvalue_type>;
+        using table = hilbert_table<dim>;
+
+        std::size_t s = 0;
+        for (std::size_t i = 0; i < ndigits; ++i)
+        {
+            const std::size_t shift = dim*(definition::nlevels-1-i);
+            s = table::next[s*table::treetype + (static_cast<std::size_t>(value >> shift)&(table::treetype-1))];
+        }
+        return s;
+    }
+
+    template<std::size_t dim>
+    static constexpr std::size_t child(std::size_t state, std::size_t rank)
+    {
+        return hilbert_table<dim>::child_of(state, rank);
+    }
+};
+
+//! compare two nodes in the given order: by position along the curve,
+//! and by level for nodes at the same place (the ancestors first).
+template<typename TOrder = ZOrder, typename node_type>
+inline bool less(node_type const& a, node_type const& b)
+{
+    using zvalue_type = typename node_type::zvalue_type;
+    using definition = definitions<node_type::dim, zvalue_type>;
+    const zvalue_type ka = TOrder::template key<node_type::dim>(a.value)&definition::maskpos;
+    const zvalue_type kb = TOrder::template key<node_type::dim>(b.value)&definition::maskpos;
+    return ka < kb || (ka == kb && a.level() < b.level());
+}
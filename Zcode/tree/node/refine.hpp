@@ -1,16 +1,26 @@
 #pragma once
 
+#include <cassert>
+
 #include <tree/node/cell.hpp>
+#include <tree/node/ordering.hpp>
 
 //! refine n. Results in refined[0: treetype-1].
 //! \param  n: node.
-//! \param refined[]: the refined nodes.
-template<typename Node_type, typename Node_array>
+//! \param refined[]: the refined nodes, in the order given by TOrder.
+template<typename TOrder = ZOrder, typename Node_type, typename Node_array>
 void refine(Node_type const& n, Node_array & refined)
   {
-    typename Node_type::type nnew = n.value + Node_type::levelone;//we add one level.
-    auto level = n.level() + 1;
-    refined[0].value = nnew;// <=> add zero at right <=> do not modify n.
-    for(int i=1; i< Node_type::treetype; ++i)
-        refined[i].value = nnew + (Node_type::TailGen[i]>>(Node_type::dim*level));
+    using zvalue_type = typename Node_type::zvalue_type;
+    using definition = definitions<Node_type::dim, zvalue_type>;
+    constexpr std::size_t dim = Node_type::dim;
+
+    const std::size_t level = n.level() + 1;
+    assert( level < definition::nlevels );
+
+    const zvalue_type nnew = n.value + definition::levelone;//we add one level.
+    const std::size_t shift = dim*(definition::nlevels-1-level);
+    const std::size_t state = TOrder::template state<dim>(n.value, level);
+    for(std::size_t i=0; i < definition::treetype; ++i)
+        refined[i].value = nnew + (static_cast<zvalue_type>(TOrder::template child<dim>(state, i)) << shift);
   }
@@ -0,0 +1,167 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#include <tree/node/util.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Compile-time stencil shapes.
+///
+/// A stencil shape is a type with:
+///  - static constexpr std::size_t dim: the dimension,
+///  - static constexpr std::size_t size: the number of offsets,
+///  - static constexpr int offset(std::size_t i, std::size_t d): the
+///    component d of the offset i.
+///
+/// The offset tables are then built at compile time by neighbors<TStencil>()
+/// (see neighbor.hpp).
+///
+/// Use it like:
+///
+///  struct MyStencil
+///  {
+///      static constexpr std::size_t dim = 2;
+///      static constexpr std::size_t size = 2;
+///      static constexpr int offset(std::size_t i, std::size_t d)
+///      { return (i == d) ? 1: 0; }
+///  };
+///
+///  std::array<std::size_t, MyStencil::size> neighbors_array;
+///  neighbors<MyStencil>(node, neighbors_array);
+///
+/// \brief stencil shapes known at compile time.
+////////////////////////////////////////////////////////////////////////
+
+//! box stencil: all the offsets in [-radius, radius]^dim.
+//! \note x is the fastest index, z the slowest (same order as boxNeighbors).
+template<std::size_t Dim, std::size_t radius>
+struct BoxStencil
+{
+    static constexpr std::size_t dim = Dim;
+    static constexpr std::size_t size = ipow(2*radius+1, Dim);
+
+    static constexpr int offset(std::size_t i, std::size_t d)
+    {
+        return static_cast<int>((i/ipow(2*radius+1, d))%(2*radius+1)) - static_cast<int>(radius);
+    }
+};
+
+//! star stencil: the offsets in [-radius, radius] in each direction,
+//! without the center.
+//! \note the directions are ordered x, y, z and the offsets from -radius
+//! to radius (same order as starNeighbors).
+template<std::size_t Dim, std::size_t radius>
+struct StarStencil
+{
+    static constexpr std::size_t dim = Dim;
+    static constexpr std::size_t size = 2*radius*Dim;
+
+    static constexpr int offset(std::size_t i, std::size_t d)
+    {
+        return (i/(2*radius) != d) ? 0
+             : (i%(2*radius) < radius) ? static_cast<int>(i%(2*radius)) - static_cast<int>(radius)
+             : static_cast<int>(i%(2*radius)) - static_cast<int>(radius) + 1;
+    }
+};
+
+//! sum of the absolute values of a box offset.
+template<typename TBox>
+constexpr std::size_t box_norm1(std::size_t i)
+{
+    std::size_t n = 0;
+    for (std::size_t d = 0; d < TBox::dim; ++d)
+        n += (TBox::offset(i, d) < 0) ? -TBox::offset(i, d): TBox::offset(i, d);
+    return n;
+}
+
+//! number of offsets of the box kept by the predicate.
+template<typename TBox, typename TPredicate>
+constexpr std::size_t filtered_size()
+{
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < TBox::size; ++i)
+        if (TPredicate::template keep<TBox>(i))
+            ++n;
+    return n;
+}
+
+//! index in the box of the i-th offset kept by the predicate.
+template<typename TBox, typename TPredicate>
+constexpr std::size_t filtered_index(std::size_t i)
+{
+    std::size_t j = 0;
+    for (; j < TBox::size; ++j)
+        if (TPredicate::template keep<TBox>(j) && i-- == 0)
+            break;
+    return j;
+}
+
+//! sub-stencil of a box stencil: the box offsets for which
+//! TPredicate::keep<TBox>(box_index) is true.
+//! \note TPredicate::keep must be a static constexpr function.
+template<std::size_t Dim, std::size_t radius, typename TPredicate>
+struct FilteredStencil
+{
+    using box_type = BoxStencil<Dim, radius>;
+    static constexpr std::size_t dim = Dim;
+    static constexpr std::size_t size = filtered_size<box_type, TPredicate>();
+
+    static constexpr int offset(std::size_t i, std::size_t d)
+    {
+        return box_type::offset(filtered_index<box_type, TPredicate>(i), d);
+    }
+};
+
+//! keep the offsets of the box whose bit is set in the mask.
+template<std::uint64_t mask>
+struct mask_predicate
+{
+    template<typename TBox>
+    static constexpr bool keep(std::size_t i)
+    {
+        return (mask >> i)&1;
+    }
+};
+
+//! keep the offsets with at most n non zero components (without the center).
+template<std::size_t n>
+struct norm1_predicate
+{
+    template<typename TBox>
+    static constexpr bool keep(std::size_t i)
+    {
+        return box_norm1<TBox>(i) > 0 && box_norm1<TBox>(i) <= n;
+    }
+};
+
+//! arbitrary shape in the box [-radius, radius]^dim: the bit i of
+//! the mask selects the offset i of BoxStencil<dim, radius>.
+template<std::size_t Dim, std::size_t radius, std::uint64_t mask>
+using MaskStencil = FilteredStencil<Dim, radius, mask_predicate<mask>>;
+
+//! face neighbors (1d: 2, 2d: 4, 3d: 6).
+template<std::size_t Dim>
+using FaceStencil = FilteredStencil<Dim, 1, norm1_predicate<1>>;
+
+//! face and edge neighbors (1d: 2, 2d: 8, 3d: 18).
+template<std::size_t Dim>
+using FaceEdgeStencil = FilteredStencil<Dim, 1, norm1_predicate<2>>;
+
+//! face, edge and corner neighbors (1d: 2, 2d: 8, 3d: 26).
+template<std::size_t Dim>
+using CornerStencil = FilteredStencil<Dim, 1, norm1_predicate<Dim>>;
+
+//! return the offset i of a stencil in an array.
+template<typename TStencil, std::size_t... d>
+constexpr std::array<int, TStencil::dim> stencil_offset(std::size_t i, std::index_sequence<d...>)
+{
+    return {{TStencil::offset(i, d)...}};
+}
+
+template<typename TStencil>
+constexpr std::array<int, TStencil::dim> stencil_offset(std::size_t i)
+{
+    return stencil_offset<TStencil>(i, std::make_index_sequence<TStencil::dim>{});
+}
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <tree/node/definitions.hpp>
+#include <tree/node/dilate.hpp>
 #include <tree/node/direction.hpp>
 
+#include <array>
+#include <cassert>
+#include <utility>
 #include <vector>
 
 
@@ -16,6 +20,7 @@ public:
     using derived_type  = TDerived;
     using zvalue_type    = TValue;
     using definition    = definitions<dim, zvalue_type>;
+    using coords_type   = std::array<zvalue_type, dim>;
 
     zvalue_type value = 0;
 
@@ -73,10 +78,109 @@ public:
         return ((move&mask)&definition::AllOnes[level()]) + keep + is_void;
     }
 
+    //! shift the znode by an offset vector, in constant time.
+    //! All the directions are moved at once using dilated integer
+    //! additions and subtractions in their lane.
+    //! \param offset the signed shift in each direction.
+    //! \note gives the same result as chained calls to plus and minus
+    //! for offsets in ]-2^(level+1), 2^(level+1)[.
+    inline zvalue_type plus(std::array<int, dim> const& offset) const
+    {
+        std::array<zvalue_type, dim> dec;
+        for (std::size_t d = 0; d < dim; ++d)
+            dec[d] = dilate<dim>(_abs(offset[d]), d);
+        return _move(offset, dec);
+    }
+
+    //! shift the znode by an offset vector known at compile time.
+    //! \param offset the signed shift in each direction.
+    //! \note same as plus(std::array<int, dim>{offset...}), the dilated
+    //! offsets being computed at compile time.
+    template<int... offset>
+    inline zvalue_type plus() const
+    {
+        static_assert(sizeof...(offset) == dim, "One offset per direction is needed.");
+        constexpr std::array<int, dim> off{{offset...}};
+        constexpr std::array<zvalue_type, dim> dec = _dilated(off, std::make_index_sequence<dim>{});
+        return _move(off, dec);
+    }
+
+    //! shift the znode by stencil in the direction d (compile-time version).
+    template<direction d, std::size_t stencil=1>
+    inline zvalue_type plus() const
+    {
+        static_assert(static_cast<std::size_t>(d) < dim, "The direction is not valid.");
+        constexpr auto off = _directional(static_cast<int>(stencil), static_cast<std::size_t>(d), std::make_index_sequence<dim>{});
+        constexpr std::array<zvalue_type, dim> dec = _dilated(off, std::make_index_sequence<dim>{});
+        return _move(off, dec);
+    }
+
+    //! shift the znode by -stencil in the direction d (compile-time version).
+    template<direction d, std::size_t stencil=1>
+    inline zvalue_type minus() const
+    {
+        static_assert(static_cast<std::size_t>(d) < dim, "The direction is not valid.");
+        constexpr auto off = _directional(-static_cast<int>(stencil), static_cast<std::size_t>(d), std::make_index_sequence<dim>{});
+        constexpr std::array<zvalue_type, dim> dec = _dilated(off, std::make_index_sequence<dim>{});
+        return _move(off, dec);
+    }
+
+    static constexpr zvalue_type _abs(int o)
+    {
+        return static_cast<zvalue_type>((o < 0) ? -static_cast<long>(o): o);
+    }
+
+    template<std::size_t... d>
+    static constexpr std::array<zvalue_type, dim> _dilated(std::array<int, dim> const& offset, std::index_sequence<d...>)
+    {
+        return {{dilate_constexpr<dim>(_abs(offset[d]), d)...}};
+    }
+
+    template<std::size_t... i>
+    static constexpr std::array<int, dim> _directional(int stencil, std::size_t d, std::index_sequence<i...>)
+    {
+        return {{(i == d) ? stencil: 0 ...}};
+    }
+
+    //! move the lane d of the znode.
+    //! \param d the lane (0: x, 1: y, 2: z).
+    //! \param offset the signed shift.
+    //! \param dec the dilated absolute value of offset (finest level).
+    //! \return the bits of the lane, with the voidbit set if the move
+    //! goes out of the domain.
+    inline zvalue_type _moveLane(std::size_t d, int offset, zvalue_type dec) const
+    {
+        const zvalue_type mask = definition::XMask >> d;
+        if (offset == 0)
+            return value&mask;
+
+        const std::size_t lev = level();
+        const zvalue_type tmp = definition::maskpos - mask;
+        const zvalue_type dec_level = dec << (dim*(definition::nlevels-1-lev));
+        const zvalue_type move = (offset > 0) ? (value&mask) + (dec_level|tmp): (value&mask) - dec_level;
+        const bool is_void = (move&(~definition::maskpos)) || (_abs(offset) >> lev) > 1;
+        return (move&mask&definition::AllOnes[lev]) | (is_void ? definition::voidbit: 0);
+    }
+
+    //! move each lane of the znode by its dilated offset.
+    //! \param offset the signed shift in each direction.
+    //! \param dec the dilated absolute value of offset (finest level).
+    inline zvalue_type _move(std::array<int, dim> const& offset, std::array<zvalue_type, dim> const& dec) const
+    {
+        zvalue_type moved = value&(definition::levelzone|definition::voidbit);
+        bool is_moved = false;
+        for (std::size_t d = 0; d < dim; ++d)
+        {
+            moved |= _moveLane(d, offset[d], dec[d]);
+            is_moved = is_moved || offset[d] != 0;
+        }
+        return is_moved ? moved: value;
+    }
+
     inline void setLevel(std::size_t lev)
     {
         assert( lev < definition::nlevels );
-        value = (value&definition::maskpos) + (lev<<definition::levelshift);
+        value = (value&definition::maskpos) + (static_cast<zvalue_type>(lev)<<definition::levelshift);
     }
 
     // test if the znode is void.
@@ -99,7 +203,7 @@ public:
         value ^= (tags&definition::FreeBitsPart)&(value&definition::FreeBitsPart);
     }
 
-    inline bool hasTags(const zvalue_type & tags)
+    inline bool hasTags(const zvalue_type & tags) const
     {
         return (value&tags)&definition::FreeBitsPart;
     }
@@ -152,7 +256,7 @@ public:
     inline std::size_t lastlevel() const
     {
         auto l = level();
-        return (value&(definition::XYZbit>>(dim*l)))>> (dim*(definition::nlevels-l+1));
+        return static_cast<std::size_t>((value&(definition::XYZbit>>(dim*l)))>> (dim*(definition::nlevels-1-l)));
     }
 
     //! is a node minimal (ie has minimal abscissa) in his set of Brothers?
@@ -168,6 +272,69 @@ public:
         return value >> definition::levelshift;
     }
 
+    //! build a znode from its integer coordinates at a given level.
+    //! \param coords the coordinates, each one in [0, 2^(level+1)[.
+    //! \param level the level.
+    //! \note uses pdep if BMI2 is available.
+    static inline zvalue_type encode(coords_type const& coords, std::size_t level)
+    {
+        assert( level < definition::nlevels );
+        zvalue_type pos = 0;
+        for (std::size_t d = 0; d < dim; ++d)
+        {
+            assert( (coords[d] >> level) <= 1 );
+            pos |= dilate<dim>(coords[d], d);
+        }
+        return (pos << (dim*(definition::nlevels-1-level)))
+               + (static_cast<zvalue_type>(level) << definition::levelshift);
+    }
+
+    //! build an array of znodes from integer coordinates at a given level.
+    //! \param coords the coordinates (size elements).
+    //! \param size the number of znodes to build.
+    //! \param level the level.
+    //! \param output the built znode values (size elements).
+    static inline void encode(coords_type const* coords, std::size_t size,
+                              std::size_t level, zvalue_type* output)
+    {
+        assert( level < definition::nlevels );
+        const std::size_t shift = dim*(definition::nlevels-1-level);
+        const zvalue_type levelpart = static_cast<zvalue_type>(level) << definition::levelshift;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            zvalue_type pos = 0;
+            for (std::size_t d = 0; d < dim; ++d)
+                pos |= dilate<dim>(coords[i][d], d);
+            output[i] = (pos << shift) + levelpart;
+        }
+    }
+
+    //! return the integer coordinates of the znode at its level.
+    //! \note this can be applied to hashed and non hashed znodes.
+    inline coords_type coordinates() const
+    {
+        const zvalue_type pos = (value&definition::maskpos) >> (dim*(definition::nlevels-1-level()));
+        coords_type coords;
+        for (std::size_t d = 0; d < dim; ++d)
+            coords[d] = undilate<dim>(pos, d);
+        return coords;
+    }
+
+    //! compute the integer coordinates of an array of znodes.
+    //! \param input the znode values (size elements).
+    //! \param size the number of znodes.
+    //! \param coords the coordinates of each znode at its level (size elements).
+    static inline void decode(zvalue_type const* input, std::size_t size, coords_type* coords)
+    {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            const std::size_t level = input[i] >> definition::levelshift;
+            const zvalue_type pos = (input[i]&definition::maskpos) >> (dim*(definition::nlevels-1-level));
+            for (std::size_t d = 0; d < dim; ++d)
+                coords[i][d] = undilate<dim>(pos, d);
+        }
+    }
+
     //! Display node information
     void print_value( std::ostream & out ) const
     {
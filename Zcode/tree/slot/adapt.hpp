@@ -0,0 +1,162 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_scan.h>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/family.hpp>
+#include <tree/slot/build.hpp>
+#include <tree/slot/pack.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Bulk refinement and coarsening of a sorted pack.
+///
+/// The cells to adapt are tagged in their free bits:
+///  - refine_tag: the cell is replaced by its children,
+///  - coarsen_tag: the cell is replaced by its father if all its brothers
+///    are in the pack, next to it, and also tagged for coarsening (and
+///    not for refinement).
+///
+/// The new pack is built in one pass over the cells, without sorting:
+/// the children are written in ascending Z order and a father takes
+/// the place of its first son. The cells are split in ranges (which are
+/// Morton ranges since the pack is sorted): the size of the output is
+/// computed with a reduction, the output is allocated once and written
+/// with a scan.
+///
+/// Use it like:
+///
+///  leaves[i].setTags(adapt_tags<dim, TValue>::refine);
+///  auto adapted = adapt(leaves);
+///
+/// \brief refine and coarsen the tagged cells of a pack.
+////////////////////////////////////////////////////////////////////////
+
+//! tags used by adapt.
+template<std::size_t dim, typename TValue>
+struct adapt_tags
+{
+    using definition = definitions<dim, TValue>;
+    static constexpr TValue refine = definition::firstfreebit;
+    static constexpr TValue coarsen = definition::secondfreebit;
+    static constexpr TValue all = refine|coarsen;
+};
+
+template<std::size_t dim, typename TValue>
+constexpr TValue adapt_tags<dim, TValue>::refine;
+
+template<std::size_t dim, typename TValue>
+constexpr TValue adapt_tags<dim, TValue>::coarsen;
+
+template<std::size_t dim, typename TValue>
+constexpr TValue adapt_tags<dim, TValue>::all;
+
+//! is cells[first] the first son of a complete group of brothers tagged
+//! for coarsening?
+template<std::size_t dim, typename TValue>
+inline bool is_coarsen_group(CellPack<dim, TValue> const& cells, std::size_t first)
+{
+    using definition = definitions<dim, TValue>;
+    using tags = adapt_tags<dim, TValue>;
+    const std::size_t level = cells[first].level();
+    if (level == 0 || !cells[first].isMinimal() || first + definition::treetype > cells.size())
+        return false;
+
+    const TValue fathervalue = father(cells[first]);
+    for (std::size_t i = first; i < first + definition::treetype; ++i)
+        if ((cells[i].value&tags::all) != tags::coarsen
+            || cells[i].level() != level
+            || cells[i].lastlevel() != i - first
+            || father(cells[i]) != fathervalue)
+            return false;
+    return true;
+}
+
+//! number of cells replacing the cell i, and the first one of them.
+template<std::size_t dim, typename TValue>
+inline std::size_t adapt_cell(CellPack<dim, TValue> const& cells, std::size_t i, TValue& first)
+{
+    using definition = definitions<dim, TValue>;
+    using tags = adapt_tags<dim, TValue>;
+    auto const& cell = cells[i];
+
+    if (cell.hasTags(tags::refine) && cell.level() + 1 < definition::nlevels)
+    {
+        first = static_cast<TValue>(firstSon(cell)&definition::partWithoutFreeBits);
+        return definition::treetype;
+    }
+
+    if ((cell.value&tags::all) == tags::coarsen && cell.level() > 0)
+    {
+        const std::size_t rank = cell.lastlevel();
+        if (rank <= i && is_coarsen_group(cells, i - rank))
+        {
+            first = father(cell);
+            return (rank == 0) ? 1: 0;
+        }
+    }
+
+    first = static_cast<TValue>(cell.value&~tags::all);
+    return 1;
+}
+
+//! refine and coarsen the tagged cells of a pack (see adapt_tags).
+//! \param cells sorted cells.
+//! \return the adapted cells, sorted and without the adapt tags.
+//! \note the new cells have no tags, the other cells keep theirs.
+template<std::size_t dim, typename TValue>
+CellPack<dim, TValue> adapt(CellPack<dim, TValue> const& cells)
+{
+    using definition = definitions<dim, TValue>;
+    using range_type = tbb::blocked_range<std::size_t>;
+    const std::size_t size = cells.size();
+
+    const std::size_t output_size = tbb::parallel_reduce(range_type(0, size, build_grain), std::size_t{0},
+        [&](range_type const& r, std::size_t sum)
+        {
+            TValue first;
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+                sum += adapt_cell(cells, i, first);
+            return sum;
+        },
+        [](std::size_t a, std::size_t b){return a + b;});
+
+    CellPack<dim, TValue> output{cells.value, output_size};
+    output.resize(output_size);
+    tbb::parallel_scan(range_type(0, size, build_grain), std::size_t{0},
+        [&](range_type const& r, std::size_t sum, bool is_final)
+        {
+            TValue first;
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+            {
+                const std::size_t count = adapt_cell(cells, i, first);
+                if (is_final)
+                {
+                    if (count == 1)
+                        output[sum].value = first;
+                    else if (count > 1)
+                    {
+                        const std::size_t shift = dim*(definition::nlevels-2-cells[i].level());
+                        for (std::size_t c = 0; c < count; ++c)
+                            output[sum + c].value = static_cast<TValue>(first + (static_cast<TValue>(c) << shift));
+                    }
+                }
+                sum += count;
+            }
+            return sum;
+        },
+        [](std::size_t a, std::size_t b){return a + b;});
+    return output;
+}
+
+//! refine and coarsen the tagged cells of a collection, stored in packs
+//! of at most pack_size cells.
+template<std::size_t dim, typename TValue>
+PackCollection<dim, TValue> adapt(PackCollection<dim, TValue> const& collection, std::size_t pack_size)
+{
+    return split(adapt(flatten(collection)), pack_size);
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/family.hpp>
+#include <tree/node/neighbor.hpp>
+#include <tree/node/stencil.hpp>
+#include <tree/slot/build.hpp>
+#include <tree/slot/pack.hpp>
+#include <tree/slot/search.hpp>
+#include <tree/slot/sort.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// 2:1 balance of a linear tree: the levels of two adjacent leaves
+/// differ at most by one.
+///
+/// The adjacency is given by a stencil shape (see stencil.hpp):
+/// FaceStencil, FaceEdgeStencil or CornerStencil.
+///
+/// The balance is done level by level, from the finest one (ripple):
+/// for each cell of level l (leaf or required cell), the neighbors of its
+/// father are required at level l-1. The leaves and the required cells
+/// are then linearized and completed. Each step runs in parallel over
+/// the sorted cells.
+///
+/// Use it like:
+///
+///  auto balanced = balance<FaceStencil<3>>(leaves);
+///  assert( isBalanced<FaceStencil<3>>(balanced) );
+///
+/// \brief 2:1 balance of a linear tree.
+////////////////////////////////////////////////////////////////////////
+
+//! check the 2:1 balance of a complete linear tree.
+//! \param leaves a complete linear tree, sorted.
+template<typename TStencil, std::size_t dim, typename TValue>
+bool isBalanced(CellPack<dim, TValue> const& leaves)
+{
+    static_assert(TStencil::dim == dim, "The stencil dimension is not valid.");
+    using definition = definitions<dim, TValue>;
+    using range_type = tbb::blocked_range<std::size_t>;
+
+    return tbb::parallel_reduce(range_type(0, leaves.size(), build_grain), true,
+        [&](range_type const& r, bool balanced)
+        {
+            std::array<TValue, TStencil::size> neighbors_array;
+            for (std::size_t i = r.begin(); i < r.end() && balanced; ++i)
+            {
+                // a coarser neighbor contains the neighbor of the same level.
+                neighbors<TStencil>(leaves[i], neighbors_array);
+                for (auto neighbor : neighbors_array)
+                    if (!(neighbor&definition::voidbit)
+                        && leaves[findLeaf(leaves, neighbor)].level() + 1 < leaves[i].level())
+                        balanced = false;
+            }
+            return balanced;
+        },
+        [](bool a, bool b){return a && b;});
+}
+
+template<typename TStencil, std::size_t dim, typename TValue>
+bool isBalanced(PackCollection<dim, TValue> const& collection)
+{
+    return isBalanced<TStencil>(flatten(collection));
+}
+
+//! cells of level l-1 required by the cells of level l: the neighbors
+//! of their fathers.
+template<typename TStencil, std::size_t dim, typename TValue>
+CellPack<dim, TValue> required_cells(CellPack<dim, TValue> const& cells)
+{
+    using definition = definitions<dim, TValue>;
+    using range_type = tbb::blocked_range<std::size_t>;
+
+    CellPack<dim, TValue> fathers{0, cells.size()};
+    fathers.resize(cells.size());
+    tbb::parallel_for(range_type(0, cells.size(), build_grain), [&](range_type const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+            fathers[i].value = father(cells[i]);
+    });
+    radixSort(fathers);
+    fathers = linearize(fathers);
+
+    CellPack<dim, TValue> required{0, fathers.size()*TStencil::size};
+    required.resize(fathers.size()*TStencil::size);
+    tbb::parallel_for(range_type(0, fathers.size(), build_grain/TStencil::size + 1), [&](range_type const& r)
+    {
+        std::array<TValue, TStencil::size> neighbors_array;
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+        {
+            neighbors<TStencil>(fathers[i], neighbors_array);
+            for (std::size_t k = 0; k < TStencil::size; ++k)
+                required[i*TStencil::size + k].value = neighbors_array[k];
+        }
+    });
+    required = compact(required, [&](std::size_t i){return !(required[i].value&definition::voidbit);});
+    radixSort(required);
+    return linearize(required);
+}
+
+//! 2:1 balance of a complete linear tree.
+//! \param leaves a complete linear tree, sorted.
+//! \return the balanced tree: the leaves are only refined.
+template<typename TStencil, std::size_t dim, typename TValue>
+CellPack<dim, TValue> balance(CellPack<dim, TValue> const& leaves)
+{
+    static_assert(TStencil::dim == dim, "The stencil dimension is not valid.");
+    using cell_type = Cell<dim, TValue>;
+    using definition = definitions<dim, TValue>;
+    using range_type = tbb::blocked_range<std::size_t>;
+    const std::size_t size = leaves.size();
+
+    // the leaves sorted by level (stable counting sort)
+    std::vector<TValue> levels(size), levels_tmp(size);
+    CellPack<dim, TValue> by_level{0, size};
+    by_level.resize(size);
+    tbb::parallel_for(range_type(0, size, build_grain), [&](range_type const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+        {
+            levels[i] = static_cast<TValue>(leaves[i].level());
+            by_level[i].value = leaves[i].value&(definition::maskpos|definition::levelzone);
+        }
+    });
+    radix_buffer<cell_type> buffer{by_level.data(), size};
+    const bool odd = radix_sort_impl(levels.data(), levels_tmp.data(), size,
+                                     [&](std::size_t from, std::size_t to, bool o){buffer.move(from, to, o);});
+    buffer.finish(odd);
+    std::vector<TValue> const& sorted_levels = odd ? levels_tmp: levels;
+
+    // ripple from the finest level
+    CellPack<dim, TValue> all{0, size};
+    all.insert(all.end(), by_level.cbegin(), by_level.cend());
+    CellPack<dim, TValue> required{0, 0};
+    for (std::size_t level = definition::nlevels-1; level >= 2; --level)
+    {
+        const std::size_t first = std::lower_bound(sorted_levels.cbegin(), sorted_levels.cend(), static_cast<TValue>(level)) - sorted_levels.cbegin();
+        const std::size_t last = std::upper_bound(sorted_levels.cbegin(), sorted_levels.cend(), static_cast<TValue>(level)) - sorted_levels.cbegin();
+        if (first == last && required.size() == 0)
+            continue;
+
+        CellPack<dim, TValue> cells{0, last - first + required.size()};
+        cells.insert(cells.end(), by_level.cbegin() + first, by_level.cbegin() + last);
+        cells.insert(cells.end(), required.cbegin(), required.cend());
+        required = required_cells<TStencil>(cells);
+        all.insert(all.end(), required.cbegin(), required.cend());
+    }
+
+    radixSort(all);
+    return complete(linearize(all));
+}
+
+template<typename TStencil, std::size_t dim, typename TValue>
+PackCollection<dim, TValue> balance(PackCollection<dim, TValue> const& collection, std::size_t pack_size)
+{
+    return split(balance<TStencil>(flatten(collection)), pack_size);
+}
@@ -0,0 +1,290 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+#include <tbb/task_group.h>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/family.hpp>
+#include <tree/slot/pack.hpp>
+#include <tree/slot/sort.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Construction of a linear tree from a point cloud.
+///
+///  1. the points are encoded as cells of the finest level,
+///  2. the cells are radix sorted and the duplicates are removed (the
+///     number of points in each cell is kept),
+///  3. the tree is refined top-down from the 2^dim cells of level 0: a
+///     cell is refined while it contains more than max_points points.
+///     The points of a cell are a range of the sorted cells, split
+///     between its children by binary searches in this range only,
+///  4. the leaves (a complete linear tree, sorted) are cut in packs.
+///
+/// Each step runs in parallel (the subtrees in step 3).
+///
+/// Use it like:
+///
+///  std::vector<std::array<std::size_t, 3>> points; // finest level coordinates
+///  auto collection = buildFromPoints(points, 16, 4096);
+///
+/// \brief linear tree from a point cloud.
+////////////////////////////////////////////////////////////////////////
+
+//! under this number of cells, a subtree is built sequentially.
+constexpr std::size_t build_grain = std::size_t{1} << 12;
+
+//! encode the points at the finest level, sort them and remove the duplicates.
+//! \param points coordinates of the points at the finest level.
+//! \param start start[i] is the rank of the first point of the i-th cell
+//! in the sorted points (start.back() is the number of points).
+template<std::size_t dim, typename TValue>
+CellPack<dim, TValue> encodePoints(std::vector<std::array<TValue, dim>> const& points,
+                                   std::vector<std::size_t>& start)
+{
+    using cell_type = Cell<dim, TValue>;
+    using definition = definitions<dim, TValue>;
+    using range_type = tbb::blocked_range<std::size_t>;
+    const std::size_t size = points.size();
+
+    CellPack<dim, TValue> sorted{0, size};
+    sorted.resize(size);
+    tbb::parallel_for(range_type(0, size, build_grain), [&](range_type const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+            sorted[i].value = cell_type::encode(points[i], definition::nlevels-1);
+    });
+    radixSort(sorted);
+
+    CellPack<dim, TValue> cells{0, size};
+    cells.resize(size);
+    start.resize(size + 1);
+    const std::size_t ncells = tbb::parallel_scan(range_type(0, size, build_grain), std::size_t{0},
+        [&](range_type const& r, std::size_t sum, bool is_final)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+                if (i == 0 || sorted[i].value != sorted[i-1].value)
+                {
+                    if (is_final)
+                    {
+                        cells[sum] = sorted[i];
+                        start[sum] = i;
+                    }
+                    ++sum;
+                }
+            return sum;
+        },
+        [](std::size_t a, std::size_t b){return a + b;});
+
+    cells.resize(ncells);
+    start.resize(ncells + 1);
+    start[ncells] = size;
+    return cells;
+}
+
+//! keep the cells i for which keep(i) is true (in parallel, the order is kept).
+template<std::size_t dim, typename TValue, typename TPredicate>
+CellPack<dim, TValue> compact(CellPack<dim, TValue> const& cells, TPredicate const& keep)
+{
+    using range_type = tbb::blocked_range<std::size_t>;
+    CellPack<dim, TValue> output{cells.value, cells.size()};
+    output.resize(cells.size());
+    const std::size_t size = tbb::parallel_scan(range_type(0, cells.size(), build_grain), std::size_t{0},
+        [&](range_type const& r, std::size_t sum, bool is_final)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+                if (keep(i))
+                {
+                    if (is_final)
+                        output[sum] = cells[i];
+                    ++sum;
+                }
+            return sum;
+        },
+        [](std::size_t a, std::size_t b){return a + b;});
+    output.resize(size);
+    return output;
+}
+
+//! remove the duplicates and the cells which are the ancestor of an other one.
+//! \param cells cells sorted by radixSort.
+template<std::size_t dim, typename TValue>
+CellPack<dim, TValue> linearize(CellPack<dim, TValue> const& cells)
+{
+    return compact(cells, [&](std::size_t i)
+    {
+        return i+1 == cells.size() || !isAncestor(cells[i], cells[i+1]);
+    });
+}
+
+//! number of cells needed to fill the positions [first, last[ with the
+//! coarsest cells; emit(cell) is called for each of them.
+template<std::size_t dim, typename TValue, typename TEmit>
+std::size_t fill_gap(TValue first, TValue last, TEmit const& emit)
+{
+    using definition = definitions<dim, TValue>;
+    std::size_t count = 0;
+    while (first < last)
+    {
+        std::size_t level = 0;
+        TValue size = static_cast<TValue>(TValue{1} << (dim*(definition::nlevels-1)));
+        while ((first&(size-1)) != 0 || first + size > last)
+        {
+            ++level;
+            size = static_cast<TValue>(size >> dim);
+        }
+        emit(static_cast<TValue>(first + (static_cast<TValue>(level) << definition::levelshift)));
+        first = static_cast<TValue>(first + size);
+        ++count;
+    }
+    return count;
+}
+
+//! complete a linear tree: the holes between the cells are filled with
+//! the coarsest possible cells.
+//! \param cells sorted cells without overlap (see linearize).
+template<std::size_t dim, typename TValue>
+CellPack<dim, TValue> complete(CellPack<dim, TValue> const& cells)
+{
+    using definition = definitions<dim, TValue>;
+    using range_type = tbb::blocked_range<std::size_t>;
+    const std::size_t size = cells.size();
+
+    // the hole before the cell i (and after the last one for i == size)
+    auto end_of = [&](std::size_t i)
+    {
+        return (i == 0) ? TValue{0}
+                        : static_cast<TValue>((cells[i-1].value&definition::maskpos)
+                                              + (TValue{1} << (dim*(definition::nlevels-1-cells[i-1].level()))));
+    };
+    auto start_of = [&](std::size_t i)
+    {
+        return (i == size) ? static_cast<TValue>(definition::maskpos + 1)
+                           : static_cast<TValue>(cells[i].value&definition::maskpos);
+    };
+
+    std::vector<std::size_t> offsets(size + 2, 0);
+    tbb::parallel_for(range_type(0, size + 1, build_grain), [&](range_type const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+            offsets[i+1] = fill_gap<dim>(end_of(i), start_of(i), [](TValue){}) + (i < size);
+    });
+    for (std::size_t i = 0; i <= size; ++i)
+        offsets[i+1] += offsets[i];
+
+    CellPack<dim, TValue> output{cells.value, offsets.back()};
+    output.resize(offsets.back());
+    tbb::parallel_for(range_type(0, size + 1, build_grain), [&](range_type const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+        {
+            std::size_t o = offsets[i];
+            fill_gap<dim>(end_of(i), start_of(i), [&](TValue v){output[o++].value = v;});
+            if (i < size)
+                output[o] = cells[i];
+        }
+    });
+    return output;
+}
+
+template<typename cell_type, typename TPack>
+void build_leaves(cell_type const& cell, std::size_t first, std::size_t last,
+                  TPack const& cells, std::vector<std::size_t> const& start,
+                  std::size_t max_points, std::vector<cell_type>& leaves);
+
+//! build the subtrees of the children of a cell.
+//! \param son the first child.
+//! \param first, last range of the cells of the points in the parent.
+template<typename cell_type, typename TPack>
+void build_children(typename cell_type::zvalue_type son, std::size_t first, std::size_t last,
+                    TPack const& cells, std::vector<std::size_t> const& start,
+                    std::size_t max_points, std::vector<cell_type>& leaves)
+{
+    using zvalue_type = typename cell_type::zvalue_type;
+    using definition = definitions<cell_type::dim, zvalue_type>;
+    constexpr std::size_t treetype = definition::treetype;
+    const std::size_t level = cell_type{son}.level();
+    const std::size_t shift = cell_type::dim*(definition::nlevels-1-level);
+
+    // bounds of the children in the points: no search if all the points
+    // are in the same child.
+    const bool same = first < last && shareAncestor(cells[first], cells[last-1], level);
+    std::array<std::size_t, treetype + 1> bounds;
+    bounds[treetype] = last;
+    for (std::size_t c = 0; c < treetype; ++c)
+    {
+        const zvalue_type pos = (son&definition::maskpos) + (static_cast<zvalue_type>(c) << shift);
+        if (same)
+            bounds[c] = (pos <= (cells[first].value&definition::maskpos)) ? first: last;
+        else
+            bounds[c] = std::lower_bound(cells.cbegin() + first, cells.cbegin() + last, pos,
+                                         [](cell_type const& a, zvalue_type p){return (a.value&definition::maskpos) < p;})
+                      - cells.cbegin();
+    }
+
+    auto child = [&](std::size_t c){return cell_type{static_cast<zvalue_type>(son + (static_cast<zvalue_type>(c) << shift))};};
+    if (last - first > build_grain)
+    {
+        std::array<std::vector<cell_type>, treetype> parts;
+        tbb::task_group group;
+        for (std::size_t c = 0; c < treetype; ++c)
+            group.run([&, c]{build_leaves(child(c), bounds[c], bounds[c+1], cells, start, max_points, parts[c]);});
+        group.wait();
+        for (auto const& part : parts)
+            leaves.insert(leaves.end(), part.cbegin(), part.cend());
+    }
+    else
+        for (std::size_t c = 0; c < treetype; ++c)
+            build_leaves(child(c), bounds[c], bounds[c+1], cells, start, max_points, leaves);
+}
+
+//! build the subtree of a cell: it is a leaf if it contains at most
+//! max_points points (or if it is at the finest level).
+template<typename cell_type, typename TPack>
+void build_leaves(cell_type const& cell, std::size_t first, std::size_t last,
+                  TPack const& cells, std::vector<std::size_t> const& start,
+                  std::size_t max_points, std::vector<cell_type>& leaves)
+{
+    using definition = definitions<cell_type::dim, typename cell_type::zvalue_type>;
+    assert( first == last || isAncestor(cell, cells[first]) );
+
+    if (start[last] - start[first] <= max_points || cell.level() == definition::nlevels-1)
+        leaves.push_back(cell);
+    else
+        build_children<cell_type>(firstSon(cell), first, last, cells, start, max_points, leaves);
+}
+
+//! complete linear tree with at most max_points points in each leaf.
+//! \param points coordinates of the points at the finest level.
+//! \return the leaves, sorted.
+//! \note a leaf of the finest level can contain more than max_points points.
+template<std::size_t dim, typename TValue>
+CellPack<dim, TValue> buildLeaves(std::vector<std::array<TValue, dim>> const& points, std::size_t max_points)
+{
+    using cell_type = Cell<dim, TValue>;
+
+    std::vector<std::size_t> start;
+    auto const cells = encodePoints(points, start);
+
+    std::vector<cell_type> leaves;
+    build_children<cell_type>(TValue{0}, 0, cells.size(), cells, start, max_points, leaves);
+
+    CellPack<dim, TValue> pack{0, leaves.size()};
+    pack.insert(pack.end(), leaves.cbegin(), leaves.cend());
+    return pack;
+}
+
+//! complete linear tree with at most max_points points in each leaf,
+//! stored in packs of at most pack_size cells.
+template<std::size_t dim, typename TValue>
+PackCollection<dim, TValue> buildFromPoints(std::vector<std::array<TValue, dim>> const& points,
+                                            std::size_t max_points, std::size_t pack_size)
+{
+    return split(buildLeaves(points, max_points), pack_size);
+}
@@ -1,128 +1,180 @@
 #pragma once
-#include <memory>
-
-#include "tree/slot/slot.hpp"
-
-template<std::size_t dim, typename value_type> 
-struct Cache
+#include <array>
+#include <cstddef>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/definitions.hpp>
+#include <tree/slot/pack.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Finger cache of the last slots found in a slotCollection.
+///
+/// The cache keeps raw handles (rank, address and interval) of the last
+/// slots used. They are valid as long as the slots of the collection are
+/// not cut, merged or moved: the collection has an epoch number, bumped
+/// at each of these changes, and the cache is emptied when the epoch of
+/// the collection is not the one of its entries. A hit is a few
+/// comparisons, without any atomic operation or shared write.
+///
+/// A cache must not be shared between threads: use one per thread, e.g.
+///
+///  tbb::enumerable_thread_specific<Cache<3>> caches;
+///  tbb::parallel_for(..., [&](auto const& r)
+///  {
+///      auto& cache = caches.local();
+///      collection.count(cell, cache);
+///  });
+///
+/// The slots are CellPack by default; TSlot is the type of the slots of
+/// other collections (see OutOfCoreCollection).
+///
+/// \brief per-thread cache of slots.
+////////////////////////////////////////////////////////////////////////
+
+template<std::size_t dim, typename TValue = std::size_t, std::size_t Size = 8, typename TSlot = CellPack<dim, TValue>>
+class Cache
 {
-    static const int size = 10;
-    using slot_type         = slot<dim, value_type>;
-    using slot_weak_type    = std::weak_ptr<slot_type>;
-    using slot_shared_type  = std::shared_ptr<slot_type>; 
-    using node_type = typename slot_type::node_type;
-
-    Cache(const Cache&) = default;
-    
-    mutable std::size_t current, newest;
-    std::array<slot_weak_type, size>    st; 
-    std::array<std::size_t, size>       pos;    //!< Last node position found by SlotCollection::find() 
-    //ZZ! pos is *not* initialized by SlotCollection::put !! use
-    // this->getslot()->lastPos() for this. !!!
-
-    //! constructor
-    //! \note does not seem necessary. But gcc warns otherwise.
+public:
+    static constexpr std::size_t size = Size;
+    using slot_type = TSlot;
+    using cell_type = Cell<dim, TValue>;
+    using definition = definitions<dim, TValue>;
+
     Cache()
     {
         reset();
     }
 
-    //! Is a Node in the slots pointed?
-    //! \param hashN the Node
-    //! \note hashN *must* be hashed!
-    inline slot_shared_type find(node_type hashN) const
+    //! rank of the slot containing the position of a cell.
+    //! \param collection the slotCollection (see slotCollection::findSlot).
+    template<typename TCollection>
+    inline std::size_t find(TCollection const& collection, cell_type const& cell)
     {
-        const auto slot_it = std::find_if(st.cbegin(), st.cend(), [&](auto &n){ auto slot = n.lock(); return ( slot && hashN >= slot->s1 && hashN < slot->s2 ); });
-        if ( slot_it != st.cend() )
+        if (owner != &collection || epoch != collection.epoch())
         {
-            current = std::distance( st.cbegin(), slot_it );
-            return slot_it->lock();
+            reset();
+            owner = &collection;
+            epoch = collection.epoch();
         }
-        
-        return nullptr;
+
+        const TValue pos = cell.value&definition::maskpos;
+        for (std::size_t k = 0; k < size; ++k)
+        {
+            const std::size_t i = (newest + size - k)%size;
+            if (st[i].slot && pos >= st[i].s1 && pos < st[i].s2)
+            {
+                ++nhits;
+                current = i;
+                return st[i].rank;
+            }
+        }
+
+        ++nmisses;
+        const std::size_t rank = collection.findSlot(cell);
+        putSlot(&collection[rank], rank, collection.s1(rank), collection.s2(rank));
+        return rank;
     }
 
-    //! return a reference to the Node pointed.
-    inline node_type& reference() const  
+    //! store a slot as the newest entry (the oldest one is dropped).
+    inline void putSlot(slot_type const* slot, std::size_t rank, TValue s1, TValue s2)
     {
-        return st[current][pos[current]];
+        newest = (newest + 1)%size;
+        st[newest] = entry{slot, rank, s1, s2, 0};
+        current = newest;
     }
-    //! return a pointer to the Node pointed.
-    //inline Node* pointerTo() const  {return st[current]->pointerto(pos[current]);}
-    
-    //! return a pointer to the slot.
-    //! TODO
-    inline slot_weak_type& getslot() const 
-    {
-        return st[current];
+
+    //! the slot pointed.
+    inline slot_type const& getslot() const
+    {
+        return *st[current].slot;
     }
- 
-    //! return the rank in the slot.
-    inline std::size_t rankInSlot() const 
+
+    //! rank of the pointed slot in the collection.
+    inline std::size_t slotRank() const
     {
-        return pos[current];
+        return st[current].rank;
     }
 
-    //! return global rank.
-    inline std::size_t globalrank() const 
+    //! size of the pointed slot.
+    inline std::size_t sizeOfSlot() const
     {
-        return st[current].Startrank() + pos[current];
+        return st[current].slot->size();
     }
 
-    //! return the rank of the pointed slot.
-    inline std::size_t slotRank() const 
+    //! lower bound of the pointed slot.
+    inline TValue S1() const
     {
-        return st[current].Slotrank();
+        return st[current].s1;
     }
 
-    //! return the size of pointed slot
-    inline std::size_t sizeOfSlot() const 
+    //! upper bound of the pointed slot.
+    inline TValue S2() const
     {
-        return st[current].size();
+        return st[current].s2;
     }
 
-    //! return s1
-    inline node_type S1() const 
+    //! rank in the pointed slot of the last cell found.
+    inline std::size_t rankInSlot() const
     {
-        return st[current].s1;
+        return st[current].pos;
     }
 
-    //! return s2
-    inline node_type S2() const 
+    //! set the rank in the pointed slot.
+    inline void setrankInSlot(std::size_t r)
     {
-        return st[current].s2;
+        st[current].pos = r;
     }
 
-    //! put the datas of a slot
-    //! \param slo the slot
-    inline void putSlot( slot_shared_type const & slot_ptr )
+    //! rank of the last cell found in the whole collection.
+    //! \note the ranks of the collection must be up to date (see slotCollection::finalize).
+    template<typename TCollection>
+    inline std::size_t globalrank(TCollection const& collection) const
     {
-        //find the oldest slot:
-        //int oldest=(newest+size-1)%size;
-        std::size_t oldest = (newest+1)%size;
+        return collection.startRank(st[current].rank) + st[current].pos;
+    }
 
-        st[oldest] = slot_ptr;
+    //! the lookups found in the cache.
+    inline std::size_t hits() const
+    {
+        return nhits;
+    }
 
-        newest = oldest;
-        current = newest;
+    //! the lookups not found in the cache.
+    inline std::size_t misses() const
+    {
+        return nmisses;
     }
 
-    //! set the rank to r.
-    //! \param r
-    inline void setrankInSlot(std::size_t r)
+    inline void resetCounters()
     {
-        pos[current] = r;
+        nhits = 0;
+        nmisses = 0;
     }
-    
-    //! reset.
+
+    //! empty the cache (the counters are kept).
     inline void reset()
     {
-
-        // for(int i=0;i<size;i++)
-        // {
-        // st[i]=0; s1[i]=0;s2[i]=0;pos[i]=0;
-        // }
-        // current=0; newest=0;
+        st.fill(entry{});
+        current = newest = 0;
+        owner = nullptr;
     }
+
+private:
+    struct entry
+    {
+        slot_type const* slot = nullptr;
+        std::size_t rank = 0;
+        TValue s1 = 0, s2 = 0;
+        std::size_t pos = 0;
+    };
+
+    std::array<entry, size> st;
+    std::size_t current = 0, newest = 0;
+    void const* owner = nullptr;
+    std::size_t epoch = 0;
+    std::size_t nhits = 0, nmisses = 0;
 };
 
+template<std::size_t dim, typename TValue, std::size_t Size, typename TSlot>
+constexpr std::size_t Cache<dim, TValue, Size, TSlot>::size;
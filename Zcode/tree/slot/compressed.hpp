@@ -0,0 +1,443 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/znode.hpp>
+#include <tree/slot/pack.hpp>
+#include <tree/slot/slot.hpp>
+#include <tree/slot/sort.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Read-only pack of cells, compressed by blocks of 128 cells.
+///
+/// The cells are stored in the order of their sort keys (see sortKey),
+/// which differ by small gaps. In each block:
+///  - the first key is kept as is (for the random access),
+///  - the other keys are coded by their gap to the previous one, minus
+///    the smallest gap of the block, shifted right by the trailing zeros
+///    common to the block, and bit-packed with a fixed width.
+/// The blocks of a complete level (constant gaps) take no bits at all,
+/// and the gaps of the finer levels have many trailing zeros. The
+/// decoding is branchless (a shift and a mask by key).
+///
+/// The tags (free bits) are kept in one byte by cell, only if a cell of
+/// the pack has tags.
+///
+/// The pack is built from a Slot of cells (sorted if needed) and gives
+/// it back with decompress(); the iteration and findChild work on the
+/// compressed data.
+///
+///  CompressedPack<3> compressed{pack};
+///  for (auto const& cell : compressed) ...
+///  if (compressed.findChild(cell) != compressed.cend()) ...
+///
+/// \brief compressed sorted pack of cells.
+////////////////////////////////////////////////////////////////////////
+
+template < std::size_t dim, typename TValue = std::size_t >
+class CompressedPack
+    : public ZNode< CompressedPack<dim, TValue>, dim, TValue >
+{
+public:
+    using znode_type = ZNode< CompressedPack<dim, TValue>, dim, TValue >;
+    using znode_type::value;
+    using zvalue_type = TValue;
+    using cell_type = Cell<dim, TValue>;
+    using definition = definitions<dim, TValue>;
+
+    //! number of cells by block.
+    static constexpr std::size_t block_size = 128;
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = cell_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = cell_type const*;
+        using reference = cell_type;
+
+        const_iterator() = default;
+
+        //! the first cell of a block.
+        const_iterator(CompressedPack const* _pack, std::size_t block)
+            : pack{_pack}, rank{block*block_size}
+        {
+            if (rank < pack->size())
+                start_block();
+        }
+
+        inline cell_type operator*() const
+        {
+            return pack->make_cell(key, rank);
+        }
+
+        //! rank of the cell in the pack.
+        inline std::size_t index() const
+        {
+            return rank;
+        }
+
+        //! sort key of the cell.
+        inline TValue sort_key() const
+        {
+            return key;
+        }
+
+        inline const_iterator& operator++()
+        {
+            if (++rank >= pack->size())
+                return *this;
+            if (rank%block_size == 0)
+                start_block();
+            else
+            {
+                key += base + (pack->read(bitpos, width) << shift);
+                bitpos += width;
+            }
+            return *this;
+        }
+
+        inline const_iterator operator++(int)
+        {
+            const_iterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        inline bool operator==(const_iterator const& other) const
+        {
+            return rank == other.rank;
+        }
+
+        inline bool operator!=(const_iterator const& other) const
+        {
+            return rank != other.rank;
+        }
+
+    private:
+        friend class CompressedPack;
+
+        CompressedPack const* pack = nullptr;
+        std::size_t rank = 0;
+        TValue key = 0;
+        TValue base = 0;
+        std::size_t bitpos = 0;
+        unsigned width = 0, shift = 0;
+
+        inline void start_block()
+        {
+            auto const& b = pack->blocks[rank/block_size];
+            key = b.first;
+            base = b.base;
+            bitpos = b.bitpos;
+            width = b.width;
+            shift = b.shift;
+        }
+    };
+
+    CompressedPack( zvalue_type v = 0 )
+        : znode_type{v}
+    {}
+
+    //! compress the cells of a slot (sorted by sortKey if needed).
+    template<typename TPolicy, typename TAllocator>
+    explicit CompressedPack(Slot<cell_type, TPolicy, TAllocator> const& pack)
+        : znode_type{pack.value}
+    {
+        std::vector<TValue> keys(pack.size());
+        for (std::size_t i = 0; i < pack.size(); ++i)
+            keys[i] = sortKey<dim>(pack[i].value);
+        if (std::is_sorted(keys.cbegin(), keys.cend()))
+            encode(pack, keys);
+        else
+        {
+            Slot<cell_type, TPolicy, TAllocator> sorted{pack};
+            radixSort(sorted);
+            for (std::size_t i = 0; i < sorted.size(); ++i)
+                keys[i] = sortKey<dim>(sorted[i].value);
+            encode(sorted, keys);
+        }
+    }
+
+    inline std::size_t size() const
+    {
+        return ncells;
+    }
+
+    inline bool empty() const
+    {
+        return ncells == 0;
+    }
+
+    inline std::size_t nbBlocks() const
+    {
+        return blocks.size();
+    }
+
+    //! bytes used by the compressed data.
+    inline std::size_t memory() const
+    {
+        return blocks.size()*sizeof(block_type) + words.size()*sizeof(std::uint64_t) + tags.size();
+    }
+
+    inline const_iterator begin() const
+    {
+        return {this, 0};
+    }
+
+    inline const_iterator end() const
+    {
+        const_iterator it;
+        it.pack = this;
+        it.rank = ncells;
+        return it;
+    }
+
+    inline const_iterator cbegin() const
+    {
+        return begin();
+    }
+
+    inline const_iterator cend() const
+    {
+        return end();
+    }
+
+    //! the cell of rank k (decodes the beginning of its block).
+    cell_type operator[](std::size_t k) const
+    {
+        const_iterator it{this, k/block_size};
+        while (it.rank < k)
+            ++it;
+        return *it;
+    }
+
+    //! find a cell (same value, tags included).
+    //! \return an iterator on the cell, or end().
+    const_iterator findChild(cell_type const& node) const
+    {
+        const TValue key = sortKey<dim>(node.value);
+        const const_iterator last = end();
+        for (auto it = lower_key(key); it != last && it.key == key; ++it)
+            if ((*it).value == node.value)
+                return it;
+        return last;
+    }
+
+    //! number of cells equal to node (tags included).
+    std::size_t count(cell_type const& node) const
+    {
+        const TValue key = sortKey<dim>(node.value);
+        const const_iterator last = end();
+        std::size_t n = 0;
+        for (auto it = lower_key(key); it != last && it.key == key; ++it)
+            n += ((*it).value == node.value);
+        return n;
+    }
+
+    //! decode the cells of a block.
+    //! \param out at least block_size cells.
+    //! \return the number of cells of the block.
+    std::size_t decode(std::size_t block, cell_type* out) const
+    {
+        auto const& b = blocks[block];
+        const std::size_t first = block*block_size;
+        const std::size_t n = std::min(block_size, ncells - first);
+        TValue key = b.first;
+        std::size_t pos = b.bitpos;
+        out[0] = make_cell(key, first);
+        for (std::size_t i = 1; i < n; ++i, pos += b.width)
+        {
+            key += b.base + (read(pos, b.width) << b.shift);
+            out[i] = make_cell(key, first + i);
+        }
+        return n;
+    }
+
+    //! the cells, sorted by sortKey.
+    CellPack<dim, TValue> decompress() const
+    {
+        CellPack<dim, TValue> pack{value, ncells};
+        pack.resize(ncells);
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, blocks.size()), [&](auto const& r)
+        {
+            for (std::size_t b = r.begin(); b < r.end(); ++b)
+                decode(b, pack.data() + b*block_size);
+        });
+        return pack;
+    }
+
+private:
+    struct block_type
+    {
+        TValue first;          //!< first key.
+        TValue base;           //!< smallest gap.
+        std::size_t bitpos;    //!< first bit of the packed gaps.
+        unsigned char width;   //!< bits by packed gap.
+        unsigned char shift;   //!< common trailing zeros of the gaps.
+    };
+
+    //! shift of the upper half of a 128 bits value (0 if not used).
+    static constexpr std::size_t half_shift = (sizeof(TValue) > 8) ? 64: 0;
+    static constexpr std::size_t tag_shift = dim*definition::nlevels;
+
+    std::size_t ncells = 0;
+    std::vector<block_type> blocks;
+    std::vector<std::uint64_t> words;
+    std::vector<std::uint8_t> tags;    //!< free bits of each cell (empty if none).
+
+    //! first cell whose sort key is not less than key.
+    const_iterator lower_key(TValue key) const
+    {
+        // the equal keys can start in the block before the first block
+        // whose first key is key.
+        auto it_block = std::lower_bound(blocks.cbegin(), blocks.cend(), key,
+                                         [](block_type const& b, TValue k){return b.first < k;});
+        const std::size_t b = (it_block == blocks.cbegin()) ? 0: (it_block - blocks.cbegin()) - 1;
+
+        const_iterator it{this, b};
+        const const_iterator last = end();
+        while (it != last && it.key < key)
+            ++it;
+        return it;
+    }
+
+    //! the cell of a sort key.
+    inline cell_type make_cell(TValue key, std::size_t rank) const
+    {
+        constexpr TValue levelbits = (TValue{1} << definition::nblevelbits) - 1;
+        TValue v = static_cast<TValue>(((key >> definition::nblevelbits)&definition::maskpos)
+                                       | ((key&levelbits) << definition::levelshift));
+        if (!tags.empty())
+            v |= static_cast<TValue>(TValue{tags[rank]} << tag_shift);
+        return cell_type{v};
+    }
+
+    static inline std::uint64_t read64(std::uint64_t const* w, std::size_t pos, unsigned width)
+    {
+        const std::size_t i = pos >> 6;
+        const unsigned s = pos&63;
+        std::uint64_t v = w[i] >> s;
+        // no branch: the next word is always there (padding).
+        v |= (w[i+1] << 1) << (63 - s);
+        return v&(~std::uint64_t{0} >> (64 - width));
+    }
+
+    //! the packed value of width bits at pos.
+    inline TValue read(std::size_t pos, unsigned width) const
+    {
+        if (width == 0)
+            return 0;
+        if (width <= 64)
+            return static_cast<TValue>(read64(words.data(), pos, width));
+        return static_cast<TValue>(static_cast<TValue>(read64(words.data(), pos, 64))
+                                   | (static_cast<TValue>(read64(words.data(), pos + 64, width - 64)) << half_shift));
+    }
+
+    static inline void write64(std::uint64_t* w, std::size_t pos, unsigned width, std::uint64_t v)
+    {
+        const std::size_t i = pos >> 6;
+        const unsigned s = pos&63;
+        w[i] |= v << s;
+        if (s + width > 64)
+            w[i+1] |= v >> (64 - s);
+    }
+
+    inline void write(std::size_t pos, unsigned width, TValue v)
+    {
+        if (width == 0)
+            return;
+        write64(words.data(), pos, std::min(width, 64u), static_cast<std::uint64_t>(v));
+        if (width > 64)
+            write64(words.data(), pos + 64, width - 64, static_cast<std::uint64_t>(v >> half_shift));
+    }
+
+    static inline unsigned bit_width(TValue v)
+    {
+        unsigned n = 0;
+        for (; v; v >>= 1)
+            ++n;
+        return n;
+    }
+
+    static inline unsigned trailing_zeros(TValue v)
+    {
+        unsigned n = 0;
+        for (; v && !(v&1); v >>= 1)
+            ++n;
+        return n;
+    }
+
+    //! compress sorted cells, given their keys.
+    template<typename TPack>
+    void encode(TPack const& pack, std::vector<TValue> const& keys)
+    {
+        using range_type = tbb::blocked_range<std::size_t>;
+        ncells = keys.size();
+        const std::size_t nblocks = (ncells + block_size - 1)/block_size;
+        blocks.resize(nblocks);
+
+        // the parameters of each block, then their place in the words
+        tbb::parallel_for(range_type(0, nblocks), [&](range_type const& r)
+        {
+            for (std::size_t b = r.begin(); b < r.end(); ++b)
+            {
+                const std::size_t first = b*block_size, last = std::min(ncells, first + block_size);
+                TValue base = static_cast<TValue>(~TValue{0});
+                for (std::size_t i = first + 1; i < last; ++i)
+                    base = std::min(base, static_cast<TValue>(keys[i] - keys[i-1]));
+                if (last - first == 1)
+                    base = 0;
+                TValue bits = 0;
+                for (std::size_t i = first + 1; i < last; ++i)
+                    bits |= static_cast<TValue>(keys[i] - keys[i-1] - base);
+                const unsigned shift = trailing_zeros(bits);
+                blocks[b] = block_type{keys[first], base, 0, static_cast<unsigned char>(bit_width(bits >> shift)),
+                                       static_cast<unsigned char>(shift)};
+            }
+        });
+        // each block starts on a new word: the blocks are written in parallel.
+        std::size_t nbits = 0;
+        for (auto& b : blocks)
+        {
+            b.bitpos = nbits;
+            nbits += ((block_size - 1)*b.width + 63)/64*64;
+        }
+        // a padding word, read by read64.
+        words.assign(nbits/64 + 1, 0);
+
+        tbb::parallel_for(range_type(0, nblocks), [&](range_type const& r)
+        {
+            for (std::size_t b = r.begin(); b < r.end(); ++b)
+            {
+                auto const& block = blocks[b];
+                const std::size_t first = b*block_size, last = std::min(ncells, first + block_size);
+                std::size_t pos = block.bitpos;
+                for (std::size_t i = first + 1; i < last; ++i, pos += block.width)
+                    write(pos, block.width, static_cast<TValue>((keys[i] - keys[i-1] - block.base) >> block.shift));
+            }
+        });
+
+        bool tagged = false;
+        for (std::size_t i = 0; i < ncells && !tagged; ++i)
+            tagged = (pack[i].value&definition::FreeBitsPart) != 0;
+        if (tagged)
+        {
+            tags.resize(ncells);
+            for (std::size_t i = 0; i < ncells; ++i)
+                tags[i] = static_cast<std::uint8_t>((pack[i].value&definition::FreeBitsPart) >> tag_shift);
+        }
+    }
+};
+
+template<std::size_t dim, typename TValue>
+constexpr std::size_t CompressedPack<dim, TValue>::block_size;
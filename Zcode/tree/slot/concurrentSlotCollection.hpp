@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <tbb/spin_mutex.h>
+
+#include <tree/node/cell.hpp>
+#include <tree/slot/index.hpp>
+#include <tree/slot/pack.hpp>
+#include <tree/slot/slotCollection.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Collection of slots accepting concurrent inserts.
+///
+/// The slots are chained like the leaves of a B-link tree: each slot
+/// has a spin lock, its interval [s1, s2[ and a link to its right
+/// neighbor. An insert locks only the slot of the cell, and a slot
+/// which passes slot_max_size is cut under its own lock: the upper half
+/// goes in a new slot linked on its right and s2 is lowered. A thread
+/// which reached the slot with an older view of the bounds sees that
+/// the position is not below s2 any more and follows the links to the
+/// right, so that no insert has to wait for a cut elsewhere.
+///
+/// The slots are reached through a snapshot of their bounds (a
+/// SlotIndex), rebuilt without stopping the inserts when the number of
+/// slots has grown by 1/8 since the last one: a lookup follows at most
+/// the few slots cut since then. The snapshots are kept until release.
+///
+/// The cells are stored as in slotCollection (not sorted, no check of
+/// the duplicates) and the slots are only cut, never merged: the small
+/// slots are merged when the collection is released.
+///
+/// Use it like:
+///
+///  concurrentSlotCollection<3> concurrent{collection};
+///  tbb::parallel_for(..., [&](auto const& r)
+///  {
+///      for (...)
+///          concurrent.insert(cell);
+///  });
+///  collection = concurrent.release();
+///
+/// \brief collection of slots with concurrent inserts.
+////////////////////////////////////////////////////////////////////////
+
+template < std::size_t dim, typename TValue = std::size_t >
+class concurrentSlotCollection
+{
+public:
+    using collection_type = PackCollection<dim, TValue>;
+    using slot_type = CellPack<dim, TValue>;
+    using cell_type = Cell<dim, TValue>;
+    using definition = definitions<dim, TValue>;
+
+    std::size_t slot_max_size;  //!< size of slot which triggers decomposition of a slot.
+    std::size_t slot_min_size;  //!< size of slot which triggers fusion of two slots (on release).
+
+    //! one empty slot covering the whole domain.
+    //! \param slotsize capacity of the first slot.
+    concurrentSlotCollection(std::size_t slotsize,
+                             std::size_t _slot_min_size,
+                             std::size_t _slot_max_size)
+        : slot_max_size{_slot_max_size},
+          slot_min_size{_slot_min_size}
+    {
+        assert( 2*slot_min_size <= slot_max_size );
+        collection_type packs{0, 1};
+        packs.push_back(slot_type{0, slotsize});
+        build(packs);
+    }
+
+    //! take the slots of a collection (see slotCollection::release).
+    explicit concurrentSlotCollection(slotCollection<dim, TValue>& collection)
+        : slot_max_size{collection.slot_max_size},
+          slot_min_size{collection.slot_min_size}
+    {
+        collection_type packs = collection.release();
+        build(packs);
+    }
+
+    concurrentSlotCollection(concurrentSlotCollection const&) = delete;
+    concurrentSlotCollection& operator=(concurrentSlotCollection const&) = delete;
+
+    ~concurrentSlotCollection()
+    {
+        destroy();
+    }
+
+    //! store one cell (thread safe).
+    //! \note we do not check if the cell is already stored.
+    void insert(cell_type const& cell)
+    {
+        slot_node* node = lock_slot(static_cast<TValue>(cell.value&definition::maskpos));
+        std::unique_lock<tbb::spin_mutex> lock{node->mutex, std::adopt_lock};
+        node->cells.push_back(cell);
+        if (node->cells.size() <= slot_max_size || !split_node(node))
+            return;
+        lock.unlock();
+
+        const std::size_t n = ++nslots;
+        const std::size_t indexed = indexed_slots.load(std::memory_order_relaxed);
+        if (n > indexed + indexed/8 + 8)
+            refresh_index();
+    }
+
+    //! number of stored cells equal to cell (0 or 1) (thread safe).
+    std::size_t count(cell_type const& cell) const
+    {
+        slot_node* node = lock_slot(static_cast<TValue>(cell.value&definition::maskpos));
+        std::lock_guard<tbb::spin_mutex> lock{node->mutex, std::adopt_lock};
+        return node->cells.findChild(cell) == node->cells.cend() ? 0 : 1;
+    }
+
+    //! number of slots.
+    inline std::size_t nbSlots() const
+    {
+        return nslots.load();
+    }
+
+    //! number of cells stored.
+    //! \note not thread safe.
+    std::size_t nbNodes() const
+    {
+        std::size_t count = 0;
+        for (slot_node const* node = head; node; node = node->next.load(std::memory_order_acquire))
+            count += node->cells.size();
+        return count;
+    }
+
+    //! move the slots in a slotCollection (the small slots are merged),
+    //! leaving one empty slot covering the domain.
+    //! \note not thread safe.
+    slotCollection<dim, TValue> release()
+    {
+        collection_type packs{0, nslots.load()};
+        for (slot_node* node = head; node; node = node->next.load(std::memory_order_acquire))
+            packs.push_back(std::move(node->cells));
+        destroy();
+
+        slotCollection<dim, TValue> collection{std::move(packs), slot_min_size, slot_max_size};
+        collection_type empty{0, 1};
+        empty.push_back(slot_type{0, slot_max_size});
+        build(empty);
+        return collection;
+    }
+
+private:
+    struct slot_node
+    {
+        tbb::spin_mutex mutex;
+        TValue s2;                               //!< upper bound (excluded), guarded by mutex.
+        std::atomic<slot_node*> next{nullptr};   //!< right neighbor.
+        slot_type cells;                         //!< its value is s1 (never changed).
+
+        slot_node(slot_type&& _cells, TValue _s2)
+            : s2{_s2}, cells{std::move(_cells)}
+        {}
+    };
+
+    //! bounds of the slots at some point.
+    struct snapshot
+    {
+        SlotIndex<TValue> bounds;
+        std::vector<slot_node*> nodes;
+    };
+
+    slot_node* head = nullptr;
+    std::atomic<std::size_t> nslots{0};
+    std::atomic<std::size_t> indexed_slots{0};
+    std::atomic<snapshot const*> current{nullptr};
+    std::vector<std::unique_ptr<snapshot>> snapshots;  //!< guarded by index_mutex.
+    tbb::spin_mutex index_mutex;
+
+    //! chain the packs (ordered intervals) and index them.
+    void build(collection_type& packs)
+    {
+        slot_node* last = nullptr;
+        TValue s2 = static_cast<TValue>(definition::maskpos + 1);
+        for (std::size_t i = packs.size(); i-- > 0;)
+        {
+            slot_type& cells = packs[i];
+            cells.value = (i == 0) ? 0 : static_cast<TValue>(cells.value&definition::maskpos);
+            const TValue s1 = cells.value;
+            slot_node* node = new slot_node{std::move(cells), s2};
+            node->next.store(last, std::memory_order_relaxed);
+            last = node;
+            s2 = s1;
+        }
+        head = last;
+        nslots = packs.size();
+        refresh_index();
+    }
+
+    void destroy()
+    {
+        for (slot_node* node = head; node;)
+        {
+            slot_node* next = node->next.load(std::memory_order_acquire);
+            delete node;
+            node = next;
+        }
+        head = nullptr;
+        current = nullptr;
+        snapshots.clear();
+    }
+
+    //! lock the slot whose interval contains pos.
+    slot_node* lock_slot(TValue pos) const
+    {
+        snapshot const* snap = current.load(std::memory_order_acquire);
+        slot_node* node = snap->nodes[snap->bounds.upper_bound(pos) - 1];
+        node->mutex.lock();
+        // the slot has been cut since the snapshot: go right.
+        while (pos >= node->s2)
+        {
+            slot_node* next = node->next.load(std::memory_order_acquire);
+            node->mutex.unlock();
+            node = next;
+            node->mutex.lock();
+        }
+        return node;
+    }
+
+    //! cut a locked slot at its median, the upper half in a new slot on
+    //! its right.
+    //! \note the sort is sequential: no task is run under the lock.
+    bool split_node(slot_node* node)
+    {
+        slot_type& cells = node->cells;
+        cells.sortChildren();
+        const std::size_t cut = median_cut(cells);
+        if (cut == 0)
+            return false;
+
+        slot_type upper_cells{static_cast<TValue>(cells[cut].value&definition::maskpos), slot_max_size + 1};
+        upper_cells.insert(upper_cells.end(), cells.cbegin() + cut, cells.cend());
+        cells.resize(cut);
+
+        slot_node* upper = new slot_node{std::move(upper_cells), node->s2};
+        upper->next.store(node->next.load(std::memory_order_acquire), std::memory_order_relaxed);
+        node->s2 = upper->cells.value;
+        node->next.store(upper, std::memory_order_release);
+        return true;
+    }
+
+    //! index the bounds of the slots, unless another thread does it.
+    void refresh_index()
+    {
+        std::unique_lock<tbb::spin_mutex> lock{index_mutex, std::try_to_lock};
+        if (!lock.owns_lock())
+            return;
+
+        std::unique_ptr<snapshot> snap{new snapshot};
+        std::vector<TValue> bounds;
+        for (slot_node* node = head; node; node = node->next.load(std::memory_order_acquire))
+        {
+            snap->nodes.push_back(node);
+            bounds.push_back(node->cells.value);
+        }
+        snap->bounds.assign(bounds.cbegin(), bounds.cend());
+        indexed_slots.store(snap->nodes.size(), std::memory_order_relaxed);
+        current.store(snap.get(), std::memory_order_release);
+        snapshots.push_back(std::move(snap));
+    }
+};
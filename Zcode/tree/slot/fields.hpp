@@ -0,0 +1,216 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Data attached to the cells of a slotCollection, stored as a structure
+/// of arrays indexed by the global rank of the cells:
+///
+///  rank = collection.startRank(slot) + rank in the slot
+///
+/// so that the data of the cells are contiguous and in the order of the
+/// collection (Morton order between the slots). The arrays are aligned
+/// on cache lines, for SIMD loads.
+///
+/// A field is a type giving the type of its values and its name:
+///
+///  struct density
+///  {
+///      using type = double;
+///      static char const* name() { return "density"; }
+///  };
+///
+///  CellFields<slotCollection<3>, density, pressure> fields{collection};
+///  double* rho = fields.data<density>();
+///
+/// The fields observe the collection: at each collection.finalize(),
+/// the values are moved to the new ranks of their cells (found by their
+/// value without the free bits), and the new cells get default values.
+///
+/// \brief structure of arrays of cell data.
+////////////////////////////////////////////////////////////////////////
+
+//! rank of T in TList.
+template<typename T, typename... TList>
+struct field_index;
+
+template<typename T, typename... TList>
+struct field_index<T, T, TList...> : std::integral_constant<std::size_t, 0>
+{};
+
+template<typename T, typename U, typename... TList>
+struct field_index<T, U, TList...> : std::integral_constant<std::size_t, 1 + field_index<T, TList...>::value>
+{};
+
+template < typename TCollection, typename... TFields >
+class CellFields
+    : public TCollection::observer
+{
+public:
+    using collection_type = TCollection;
+    using definition = typename TCollection::definition;
+    using zvalue_type = typename TCollection::cell_type::zvalue_type;
+
+    template<typename TField>
+    using array_type = std::vector<typename TField::type, tbb::cache_aligned_allocator<typename TField::type>>;
+
+    static constexpr std::size_t nfields = sizeof...(TFields);
+
+    //! fields of the cells of a collection, with default values.
+    //! \note the ranks of the collection are computed (see finalize).
+    explicit CellFields(collection_type& collection)
+        : owner{&collection}
+    {
+        collection.attach(this);
+        collection.finalize();
+    }
+
+    CellFields(CellFields const&) = delete;
+    CellFields& operator=(CellFields const&) = delete;
+
+    ~CellFields()
+    {
+        if (owner)
+            owner->detach(this);
+    }
+
+    //! number of cells.
+    inline std::size_t size() const
+    {
+        return keys.size();
+    }
+
+    //! the names of the fields.
+    static std::array<char const*, nfields> names()
+    {
+        return {{TFields::name()...}};
+    }
+
+    template<typename TField>
+    inline array_type<TField>& get()
+    {
+        return std::get<field_index<TField, TFields...>::value>(arrays);
+    }
+
+    template<typename TField>
+    inline array_type<TField> const& get() const
+    {
+        return std::get<field_index<TField, TFields...>::value>(arrays);
+    }
+
+    template<typename TField>
+    inline typename TField::type* data()
+    {
+        return get<TField>().data();
+    }
+
+    template<typename TField>
+    inline typename TField::type const* data() const
+    {
+        return get<TField>().data();
+    }
+
+    //! value of a field for the cell of rank k in the slot i.
+    template<typename TField>
+    inline typename TField::type& at(std::size_t i, std::size_t k)
+    {
+        return get<TField>()[owner->startRank(i) + k];
+    }
+
+    template<typename TField>
+    inline typename TField::type const& at(std::size_t i, std::size_t k) const
+    {
+        return get<TField>()[owner->startRank(i) + k];
+    }
+
+    //! move the values to the new ranks of their cells.
+    void remap(collection_type const& collection) override
+    {
+        using range_type = tbb::blocked_range<std::size_t>;
+        const std::size_t n = collection.startRank(collection.size());
+
+        std::vector<zvalue_type> new_keys(n);
+        tbb::parallel_for(range_type(0, collection.size()), [&](range_type const& r)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+            {
+                auto const& slot = collection[i];
+                for (std::size_t k = 0; k < slot.size(); ++k)
+                    new_keys[collection.startRank(i) + k] = slot[k].value&definition::partWithoutFreeBits;
+            }
+        });
+        if (new_keys == keys)
+            return;
+
+        // old rank of each new rank (npos for a new cell)
+        std::vector<std::size_t> order(keys.size());
+        std::iota(order.begin(), order.end(), std::size_t{0});
+        tbb::parallel_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){return keys[a] < keys[b];});
+        std::vector<std::size_t> from(n);
+        tbb::parallel_for(range_type(0, n), [&](range_type const& r)
+        {
+            for (std::size_t k = r.begin(); k < r.end(); ++k)
+            {
+                auto it = std::lower_bound(order.cbegin(), order.cend(), new_keys[k],
+                                           [&](std::size_t a, zvalue_type key){return keys[a] < key;});
+                from[k] = (it != order.cend() && keys[*it] == new_keys[k]) ? *it: npos;
+            }
+        });
+
+        for_each_array([&](auto& array)
+        {
+            using value_type = typename std::decay<decltype(array)>::type::value_type;
+            typename std::decay<decltype(array)>::type moved(n);
+            tbb::parallel_for(range_type(0, n), [&](range_type const& r)
+            {
+                for (std::size_t k = r.begin(); k < r.end(); ++k)
+                    moved[k] = (from[k] == npos) ? value_type{}: array[from[k]];
+            });
+            array.swap(moved);
+        });
+        keys.swap(new_keys);
+    }
+
+    void detached() override
+    {
+        owner = nullptr;
+    }
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    collection_type* owner;
+    std::vector<zvalue_type> keys;  //!< cells (without the free bits) by rank.
+    std::tuple<array_type<TFields>...> arrays;
+
+    template<typename TFunction, std::size_t... I>
+    void for_each_array(TFunction&& f, std::index_sequence<I...>)
+    {
+        int dummy[] = {0, (f(std::get<I>(arrays)), 0)...};
+        (void)dummy;
+    }
+
+    template<typename TFunction>
+    void for_each_array(TFunction&& f)
+    {
+        for_each_array(f, std::index_sequence_for<TFields...>{});
+    }
+};
+
+template<typename TCollection, typename... TFields>
+constexpr std::size_t CellFields<TCollection, TFields...>::nfields;
+
+template<typename TCollection, typename... TFields>
+constexpr std::size_t CellFields<TCollection, TFields...>::npos;
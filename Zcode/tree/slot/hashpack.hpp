@@ -0,0 +1,462 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <tree/node/cell.hpp>
+#include <tree/node/znode.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Unordered set of nodes in a flat open-addressing hash table.
+///
+/// The table is SwissTable-like: the slots are split in groups of 16,
+/// each slot has a control byte (empty, deleted, or 7 bits of the hash
+/// of its node) and a lookup compares the 16 control bytes of a group at
+/// once (one SSE2 compare, a scalar loop elsewhere) before looking at
+/// the nodes. The groups are probed quadratically and the load factor
+/// is at most 7/8, so that a lookup is O(1) expected.
+///
+/// The key of a node is its hash code (see ZNode::hash) without the
+/// free bits: a node is found whatever its tags, and the tags of a
+/// stored node can be changed in place. Its position must not.
+///
+/// The surface is the one of Slot (insert, count, findChild,
+/// removeTaggedChildren), without the order: use it for the random
+/// access lookups (neighbors), and a sorted pack for the traversals.
+///
+/// Use it like:
+///
+///  HashCellPack<3> leaves{0, n};
+///  for (auto const& cell : cells)
+///      leaves.insert(cell);
+///  if (leaves.count(neighbor)) ...
+///
+/// \brief hash table of nodes.
+////////////////////////////////////////////////////////////////////////
+
+template < typename TChildren >
+class HashPack
+    : public ZNode< HashPack<TChildren>, TChildren::dim, typename TChildren::zvalue_type >
+{
+public:
+    using znode_type = ZNode< HashPack<TChildren>, TChildren::dim, typename TChildren::zvalue_type >;
+
+    using znode_type::value;
+    using znode_type::dim;
+    using zvalue_type = typename znode_type::zvalue_type;
+    using definition = typename znode_type::definition;
+    using children_type = TChildren;
+
+    //! number of slots in a group of control bytes.
+    static constexpr std::size_t group_size = 16;
+
+private:
+    using control_type = std::int8_t;
+    static constexpr control_type empty_slot = -128;
+    static constexpr control_type deleted_slot = -2;
+
+    //! iterator on the full slots.
+    template<typename TPointer>
+    class iterator_impl
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = children_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = TPointer;
+        using reference = decltype(*std::declval<TPointer>());
+
+        iterator_impl() = default;
+        iterator_impl(control_type const* ctrl, control_type const* last, pointer slot)
+            : ctrl{ctrl}, last{last}, slot{slot}
+        {
+            skip();
+        }
+
+        //! a const_iterator from an iterator.
+        template<typename TOther, typename = std::enable_if_t<std::is_convertible<TOther, TPointer>::value>>
+        iterator_impl(iterator_impl<TOther> const& other)
+            : ctrl{other.ctrl}, last{other.last}, slot{other.slot}
+        {}
+
+        inline reference operator*() const
+        {
+            return *slot;
+        }
+
+        inline pointer operator->() const
+        {
+            return slot;
+        }
+
+        inline iterator_impl& operator++()
+        {
+            ++ctrl;
+            ++slot;
+            skip();
+            return *this;
+        }
+
+        inline iterator_impl operator++(int)
+        {
+            iterator_impl it = *this;
+            ++*this;
+            return it;
+        }
+
+        inline bool operator==(iterator_impl const& other) const
+        {
+            return slot == other.slot;
+        }
+
+        inline bool operator!=(iterator_impl const& other) const
+        {
+            return slot != other.slot;
+        }
+
+    private:
+        template<typename> friend class iterator_impl;
+
+        control_type const* ctrl = nullptr;
+        control_type const* last = nullptr;
+        pointer slot = nullptr;
+
+        inline void skip()
+        {
+            while (ctrl != last && *ctrl < 0)
+            {
+                ++ctrl;
+                ++slot;
+            }
+        }
+    };
+
+public:
+    using iterator = iterator_impl<children_type*>;
+    using const_iterator = iterator_impl<children_type const*>;
+
+    HashPack( zvalue_type value, std::size_t size=10 )
+        : znode_type{value}
+    {
+        reserve(size);
+    }
+
+    inline std::size_t size() const
+    {
+        return nfull;
+    }
+
+    inline bool empty() const
+    {
+        return nfull == 0;
+    }
+
+    //! number of slots of the table.
+    inline std::size_t capacity() const
+    {
+        return slots.size();
+    }
+
+    //! make room for size nodes without rehashing.
+    void reserve(std::size_t size)
+    {
+        std::size_t cap = group_size;
+        while (cap*7/8 < size)
+            cap *= 2;
+        if (cap > capacity())
+            rehash(cap);
+    }
+
+    inline iterator begin()
+    {
+        return {ctrl.data(), ctrl.data() + ctrl.size(), slots.data()};
+    }
+
+    inline iterator end()
+    {
+        return {ctrl.data() + ctrl.size(), ctrl.data() + ctrl.size(), slots.data() + slots.size()};
+    }
+
+    inline const_iterator begin() const
+    {
+        return {ctrl.data(), ctrl.data() + ctrl.size(), slots.data()};
+    }
+
+    inline const_iterator end() const
+    {
+        return {ctrl.data() + ctrl.size(), ctrl.data() + ctrl.size(), slots.data() + slots.size()};
+    }
+
+    inline const_iterator cbegin() const
+    {
+        return begin();
+    }
+
+    inline const_iterator cend() const
+    {
+        return end();
+    }
+
+    //! find a node, whatever its tags.
+    //! \return an iterator on the stored node, or end().
+    inline iterator findChild(children_type const & node)
+    {
+        const std::size_t i = find_slot(node);
+        return (i == npos) ? end(): iterator{ctrl.data() + i, ctrl.data() + ctrl.size(), slots.data() + i};
+    }
+
+    inline const_iterator findChild(children_type const & node) const
+    {
+        const std::size_t i = find_slot(node);
+        return (i == npos) ? end(): const_iterator{ctrl.data() + i, ctrl.data() + ctrl.size(), slots.data() + i};
+    }
+
+    //! number of stored nodes equal to node, whatever its tags (0 or 1).
+    inline std::size_t count(children_type const & node) const
+    {
+        return find_slot(node) != npos;
+    }
+
+    //! add a node if it is not already stored (the stored one is kept).
+    //! \return the stored node, and whether node was inserted.
+    std::pair<iterator, bool> insert(children_type const & node)
+    {
+        const std::uint64_t h = hash_of(node);
+        std::size_t i = find_slot(node, h);
+        if (i != npos)
+            return {iterator{ctrl.data() + i, ctrl.data() + ctrl.size(), slots.data() + i}, false};
+
+        i = free_slot(h);
+        if (ctrl[i] != deleted_slot && growth_left == 0)
+        {
+            // at most half full: the deleted slots are dropped in place.
+            rehash((nfull + 1 > capacity()*7/16) ? 2*capacity(): capacity());
+            i = free_slot(h);
+        }
+        if (ctrl[i] != deleted_slot)
+            --growth_left;
+        ctrl[i] = h2(h);
+        slots[i] = node;
+        ++nfull;
+        return {iterator{ctrl.data() + i, ctrl.data() + ctrl.size(), slots.data() + i}, true};
+    }
+
+    //! add nodes (see insert).
+    template<typename TIterator>
+    void insert(TIterator first, TIterator last)
+    {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    //! remove a node, whatever its tags.
+    //! \return the number of removed nodes (0 or 1).
+    std::size_t erase(children_type const & node)
+    {
+        const std::size_t i = find_slot(node);
+        if (i == npos)
+            return 0;
+        erase_slot(i);
+        return 1;
+    }
+
+    //! remove all the nodes.
+    void clear()
+    {
+        std::fill(ctrl.begin(), ctrl.end(), empty_slot);
+        nfull = 0;
+        growth_left = capacity()*7/8;
+    }
+
+    /// Remove all the children that have the same tag
+    /// as given in parameter
+    inline void removeTaggedChildren(zvalue_type tag)
+    {
+        if (this->hasTags(tag))
+            remove_if([&](children_type const& node)
+            {
+                return ((node.value&definition::FreeBitsPart)==(tag&definition::FreeBitsPart));
+            });
+        this->unsetTags(tag);
+    }
+
+    /// Remove all the children that have at least one bit
+    /// set to one in the freebitparts.
+    inline void removeTaggedChildren()
+    {
+        remove_if([&](children_type const& node)
+        {
+            return (node.value&definition::FreeBitsPart);
+        });
+        this->clearAllTags();
+    }
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::vector<control_type> ctrl;   //!< control byte of each slot.
+    std::vector<children_type> slots; //!< the nodes.
+    std::size_t nfull = 0;            //!< number of nodes.
+    std::size_t growth_left = 0;      //!< empty slots usable before a rehash.
+
+    //! hash of the key of a node (see ZNode::hash), mixed on 64 bits.
+    static inline std::uint64_t hash_of(children_type const& node)
+    {
+        constexpr std::size_t shift = (sizeof(zvalue_type) > 8) ? 64: 0;
+        const zvalue_type key = children_type{static_cast<zvalue_type>(node.value&definition::partWithoutFreeBits)}.hash();
+        std::uint64_t h = static_cast<std::uint64_t>(key);
+        if (sizeof(zvalue_type) > 8)
+            h ^= static_cast<std::uint64_t>(key >> shift)*0x9e3779b97f4a7c15ULL;
+        // murmur3 finalizer: the Morton keys have long runs of zero bits.
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static inline control_type h2(std::uint64_t h)
+    {
+        return static_cast<control_type>(h&0x7f);
+    }
+
+    static inline bool same_key(children_type const& a, children_type const& b)
+    {
+        return ((a.value^b.value)&definition::partWithoutFreeBits) == 0;
+    }
+
+    //! bit i is set if the i-th control byte of the group is c.
+    static inline unsigned match(control_type const* group, control_type c)
+    {
+#if defined(__SSE2__)
+        const __m128i g = _mm_loadu_si128(reinterpret_cast<__m128i const*>(group));
+        return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c))));
+#else
+        unsigned mask = 0;
+        for (std::size_t i = 0; i < group_size; ++i)
+            mask |= unsigned(group[i] == c) << i;
+        return mask;
+#endif
+    }
+
+    //! bit i is set if the i-th slot of the group is empty or deleted.
+    static inline unsigned match_free(control_type const* group)
+    {
+#if defined(__SSE2__)
+        const __m128i g = _mm_loadu_si128(reinterpret_cast<__m128i const*>(group));
+        return static_cast<unsigned>(_mm_movemask_epi8(g));
+#else
+        unsigned mask = 0;
+        for (std::size_t i = 0; i < group_size; ++i)
+            mask |= unsigned(group[i] < 0) << i;
+        return mask;
+#endif
+    }
+
+    inline std::size_t find_slot(children_type const& node) const
+    {
+        return find_slot(node, hash_of(node));
+    }
+
+    //! slot of a node, or npos.
+    std::size_t find_slot(children_type const& node, std::uint64_t h) const
+    {
+        const std::size_t mask = capacity()/group_size - 1;
+        std::size_t g = (h >> 7)&mask;
+        for (std::size_t step = 1; ; ++step)
+        {
+            control_type const* group = ctrl.data() + g*group_size;
+            for (unsigned m = match(group, h2(h)); m; m &= m - 1)
+            {
+                const std::size_t i = g*group_size + __builtin_ctz(m);
+                if (same_key(slots[i], node))
+                    return i;
+            }
+            if (match(group, empty_slot))
+                return npos;
+            g = (g + step)&mask;
+        }
+    }
+
+    //! first empty or deleted slot of the probe sequence of h.
+    std::size_t free_slot(std::uint64_t h) const
+    {
+        const std::size_t mask = capacity()/group_size - 1;
+        std::size_t g = (h >> 7)&mask;
+        for (std::size_t step = 1; ; ++step)
+        {
+            const unsigned m = match_free(ctrl.data() + g*group_size);
+            if (m)
+                return g*group_size + __builtin_ctz(m);
+            g = (g + step)&mask;
+        }
+    }
+
+    //! free a slot: it can be emptied if its group has an empty slot,
+    //! since no probe sequence goes past this group.
+    inline void erase_slot(std::size_t i)
+    {
+        if (match(ctrl.data() + (i/group_size)*group_size, empty_slot))
+        {
+            ctrl[i] = empty_slot;
+            ++growth_left;
+        }
+        else
+            ctrl[i] = deleted_slot;
+        --nfull;
+    }
+
+    template<typename TPredicate>
+    void remove_if(TPredicate predicate)
+    {
+        for (std::size_t i = 0; i < capacity(); ++i)
+            if (ctrl[i] >= 0 && predicate(slots[i]))
+                erase_slot(i);
+    }
+
+    //! move the nodes in a new table of cap slots (a power of 2).
+    void rehash(std::size_t cap)
+    {
+        std::vector<control_type> old_ctrl(cap, empty_slot);
+        std::vector<children_type> old_slots(cap);
+        std::swap(ctrl, old_ctrl);
+        std::swap(slots, old_slots);
+        nfull = 0;
+        growth_left = cap*7/8;
+        for (std::size_t i = 0; i < old_ctrl.size(); ++i)
+            if (old_ctrl[i] >= 0)
+            {
+                const std::uint64_t h = hash_of(old_slots[i]);
+                const std::size_t j = free_slot(h);
+                ctrl[j] = h2(h);
+                slots[j] = old_slots[i];
+                ++nfull;
+                --growth_left;
+            }
+    }
+};
+
+template<typename TChildren>
+constexpr std::size_t HashPack<TChildren>::group_size;
+
+template<typename TChildren>
+constexpr typename HashPack<TChildren>::control_type HashPack<TChildren>::empty_slot;
+
+template<typename TChildren>
+constexpr typename HashPack<TChildren>::control_type HashPack<TChildren>::deleted_slot;
+
+template<typename TChildren>
+constexpr std::size_t HashPack<TChildren>::npos;
+
+template<std::size_t dim, typename TValue = std::size_t>
+using HashCellPack = HashPack<Cell<dim, TValue>>;
@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Search index of the lower bounds of the slots of a collection.
+///
+/// The bounds are stored contiguously in the Eytzinger (BFS) layout: the
+/// k-th node has its children at 2k and 2k+1, so that the first levels of
+/// the search stay in cache and the nodes of the next levels can be
+/// prefetched (the 2^b descendants at depth b of a node are contiguous).
+/// The search is branchless: one comparison and one multiply-add by level.
+///
+/// The sorted bounds are kept along: a split or a merge inserts or erases
+/// one bound in them only, and the layout becomes stale. While it is
+/// stale, the lookups are binary searches in the sorted bounds. The
+/// layout is rebuilt when the bounds changed since the last build pass
+/// 1/8 of their number (as the snapshots of concurrentSlotCollection),
+/// so that a rebuild is amortized O(1) by change.
+///
+/// Use it like:
+///
+///  SlotIndex<std::size_t> index;
+///  index.assign(bounds.cbegin(), bounds.cend());
+///  std::size_t slot = index.upper_bound(pos) - 1;
+///
+/// \brief Eytzinger index of the slot bounds.
+////////////////////////////////////////////////////////////////////////
+
+template<typename TValue>
+class SlotIndex
+{
+public:
+    //! number of bounds in a cache line.
+    static constexpr std::size_t block = (sizeof(TValue) < 64) ? 64/sizeof(TValue): 1;
+
+    SlotIndex()
+    {
+        build();
+    }
+
+    //! set the bounds.
+    //! \param first, last sorted bounds.
+    template<typename TIterator>
+    void assign(TIterator first, TIterator last)
+    {
+        keys.assign(first, last);
+        build();
+    }
+
+    //! insert a bound at a given rank.
+    void insert(std::size_t rank, TValue key)
+    {
+        keys.insert(keys.begin() + rank, key);
+        changed();
+    }
+
+    //! erase the bound of a given rank.
+    void erase(std::size_t rank)
+    {
+        keys.erase(keys.begin() + rank);
+        changed();
+    }
+
+    //! rebuild the layout now if it is stale.
+    void refresh()
+    {
+        if (pending > 0)
+            build();
+    }
+
+    //! true if the lookups use the Eytzinger layout.
+    inline bool upToDate() const
+    {
+        return pending == 0;
+    }
+
+    inline std::size_t size() const
+    {
+        return keys.size();
+    }
+
+    //! the bound of a given rank.
+    inline TValue operator[](std::size_t rank) const
+    {
+        return keys[rank];
+    }
+
+    //! number of bounds less or equal to key.
+    inline std::size_t upper_bound(TValue key) const
+    {
+        const std::size_t n = keys.size();
+        if (pending > 0)
+            return std::upper_bound(keys.cbegin(), keys.cend(), key) - keys.cbegin();
+        std::size_t k = 1;
+        while (k <= n)
+        {
+            if (block*k < tree.size())
+                __builtin_prefetch(tree.data() + block*k);
+            k = 2*k + (tree[k] <= key);
+        }
+        // go up to the last node where we went left: the first bound > key.
+        k >>= __builtin_ffsll(static_cast<long long>(~k));
+        return (k == 0) ? n: rank[k];
+    }
+
+private:
+    std::vector<TValue> keys;        //!< sorted bounds.
+    std::vector<TValue> tree;        //!< bounds in Eytzinger layout (1-based).
+    std::vector<std::size_t> rank;   //!< rank in keys of each node of tree.
+    std::size_t indexed = 0;         //!< number of bounds at the last build.
+    std::size_t pending = 0;         //!< changes since the last build.
+
+    //! in-order traversal of the implicit tree.
+    void fill(std::size_t k, std::size_t& i)
+    {
+        if (k <= keys.size())
+        {
+            fill(2*k, i);
+            tree[k] = keys[i];
+            rank[k] = i++;
+            fill(2*k + 1, i);
+        }
+    }
+
+    void build()
+    {
+        tree.resize(keys.size() + 1);
+        rank.resize(keys.size() + 1);
+        std::size_t i = 0;
+        fill(1, i);
+        indexed = keys.size();
+        pending = 0;
+    }
+
+    //! a bound was inserted or erased: rebuild once enough changed.
+    void changed()
+    {
+        if (++pending > indexed/8 + 8)
+            build();
+    }
+};
+
+template<typename TValue>
+constexpr std::size_t SlotIndex<TValue>::block;
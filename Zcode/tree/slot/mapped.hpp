@@ -0,0 +1,608 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <tree/node/cell.hpp>
+#include <tree/node/znode.hpp>
+#include <tree/slot/fields.hpp>
+#include <tree/slot/pack.hpp>
+#include <tree/slot/slot.hpp>
+#include <tree/slot/slotCollection.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Binary file of a slotCollection, read back by mmap without parsing
+/// nor copying.
+///
+/// The file is the memory image of the collection (native byte order,
+/// checked at opening):
+///
+///  header                  mapped_header (version, dim, sizeof(TValue),
+///                          sizes and offsets of the arrays)
+///  bounds                  TValue[nslots], lower bound s1 of each slot
+///  ranks                   uint64[nslots+1], rank of the first cell of
+///                          each slot (see startRank), then the number
+///                          of cells
+///  cells                   TValue[ncells], the cells slot after slot
+///  field table             mapped_field[nfields] (name, size of a value,
+///                          offset)
+///  fields                  ncells values of each field (see CellFields)
+///
+/// Each array starts on a multiple of 64 bytes: mapped at a page
+/// boundary, it is aligned on cache lines. Opening a file maps it and
+/// checks its header, so that the time to restart is the time of the
+/// page faults of the slots actually used.
+///
+/// The file is mapped by mmap, or by MapViewOfFile on Windows (where it
+/// cannot be removed nor rewritten while it is mapped).
+///
+///  save("tree.zc", collection, fields);
+///  MappedCollection<3> mapped{"tree.zc"};
+///  for (std::size_t i = 0; i < mapped.size(); ++i)
+///      for (auto const& cell : mapped[i]) ...
+///  double const* rho = mapped.field<density>();
+///  slotCollection<3> collection = mapped.load();
+///
+/// \brief mmap-able binary file of a slotCollection.
+////////////////////////////////////////////////////////////////////////
+
+//! version of the binary format, changed at each change of layout.
+constexpr std::uint32_t mapped_version = 1;
+//! alignment of the arrays in the file (in bytes).
+constexpr std::size_t mapped_alignment = 64;
+
+struct mapped_header
+{
+    char magic[8];                  //!< "ZCODESC" and a null byte.
+    std::uint32_t version;
+    std::uint32_t byte_order;       //!< 0x01020304 written natively.
+    std::uint32_t dim;
+    std::uint32_t value_size;       //!< sizeof(TValue).
+    std::uint64_t nslots;
+    std::uint64_t ncells;
+    std::uint64_t nfields;
+    std::uint64_t slot_min_size;
+    std::uint64_t slot_max_size;
+    std::uint64_t bounds_offset;
+    std::uint64_t ranks_offset;
+    std::uint64_t cells_offset;
+    std::uint64_t fields_offset;
+    std::uint64_t file_size;
+};
+
+struct mapped_field
+{
+    char name[48];                  //!< null terminated.
+    std::uint64_t value_size;
+    std::uint64_t offset;
+};
+
+static_assert(sizeof(mapped_header)%8 == 0 && sizeof(mapped_field) == 64, "Unexpected padding in the file layout.");
+
+//! read-only view on children stored elsewhere (e.g. in a mapped file),
+//! with the read surface of Slot.
+template < typename TChildren, typename TPolicy = UnsortedChildren >
+class SlotView
+    : public ZNode< SlotView<TChildren, TPolicy>, TChildren::dim, typename TChildren::zvalue_type >
+{
+public:
+    using znode_type = ZNode< SlotView<TChildren, TPolicy>, TChildren::dim, typename TChildren::zvalue_type >;
+    using znode_type::value;
+    using zvalue_type = typename znode_type::zvalue_type;
+    using children_type = TChildren;
+    using policy_type = TPolicy;
+    using const_iterator = TChildren const*;
+
+    SlotView( zvalue_type s1 = 0, TChildren const* _first = nullptr, std::size_t _size = 0 )
+        : znode_type{s1}, first{_first}, last{_first + _size}
+    {}
+
+    inline std::size_t size() const
+    {
+        return static_cast<std::size_t>(last - first);
+    }
+
+    inline bool empty() const
+    {
+        return first == last;
+    }
+
+    inline TChildren const& operator[](std::size_t k) const
+    {
+        return first[k];
+    }
+
+    inline TChildren const* data() const
+    {
+        return first;
+    }
+
+    inline const_iterator begin() const
+    {
+        return first;
+    }
+
+    inline const_iterator end() const
+    {
+        return last;
+    }
+
+    inline const_iterator cbegin() const
+    {
+        return first;
+    }
+
+    inline const_iterator cend() const
+    {
+        return last;
+    }
+
+    //! find a Node (see Slot::findChild).
+    inline const_iterator findChild(children_type const& node) const
+    {
+        return TPolicy::find(cbegin(), cend(), node);
+    }
+
+private:
+    TChildren const* first;
+    TChildren const* last;
+};
+
+//! true if all the types can be copied as bytes.
+template<typename... T>
+struct mapped_trivial : std::true_type
+{};
+
+template<typename T, typename... TList>
+struct mapped_trivial<T, TList...>
+    : std::integral_constant<bool, std::is_trivially_copyable<T>::value && mapped_trivial<TList...>::value>
+{};
+
+inline std::uint64_t mapped_align(std::uint64_t offset)
+{
+    return (offset + mapped_alignment - 1)/mapped_alignment*mapped_alignment;
+}
+
+inline void mapped_pad(std::ofstream& file, std::uint64_t offset)
+{
+    static const char zeros[mapped_alignment] = {};
+    const std::uint64_t pos = static_cast<std::uint64_t>(file.tellp());
+    file.write(zeros, static_cast<std::streamsize>(offset - pos));
+}
+
+template<typename T>
+inline void mapped_write(std::ofstream& file, T const* data, std::size_t n)
+{
+    file.write(reinterpret_cast<char const*>(data), static_cast<std::streamsize>(n*sizeof(T)));
+}
+
+//! a field to save: ncells values of value_size bytes.
+struct mapped_array
+{
+    char const* name;
+    std::size_t value_size;
+    void const* data;
+};
+
+template<std::size_t dim, typename TValue>
+void save_mapped(std::string const& path, slotCollection<dim, TValue> const& collection,
+                 std::vector<mapped_array> const& fields)
+{
+    using cell_type = Cell<dim, TValue>;
+    static_assert(sizeof(cell_type) == sizeof(TValue), "A cell must be stored as its value.");
+
+    const std::size_t nslots = collection.size();
+    std::vector<std::uint64_t> ranks(nslots + 1, 0);
+    std::vector<TValue> bounds(nslots);
+    for (std::size_t i = 0; i < nslots; ++i)
+    {
+        bounds[i] = collection.s1(i);
+        ranks[i+1] = ranks[i] + collection[i].size();
+    }
+
+    mapped_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "ZCODESC", 8);
+    header.version = mapped_version;
+    header.byte_order = 0x01020304;
+    header.dim = static_cast<std::uint32_t>(dim);
+    header.value_size = static_cast<std::uint32_t>(sizeof(TValue));
+    header.nslots = nslots;
+    header.ncells = ranks.back();
+    header.nfields = fields.size();
+    header.slot_min_size = collection.slot_min_size;
+    header.slot_max_size = collection.slot_max_size;
+    header.bounds_offset = mapped_align(sizeof(header));
+    header.ranks_offset = mapped_align(header.bounds_offset + nslots*sizeof(TValue));
+    header.cells_offset = mapped_align(header.ranks_offset + (nslots + 1)*sizeof(std::uint64_t));
+    header.fields_offset = mapped_align(header.cells_offset + header.ncells*sizeof(TValue));
+
+    std::vector<mapped_field> table(fields.size());
+    std::uint64_t offset = mapped_align(header.fields_offset + fields.size()*sizeof(mapped_field));
+    for (std::size_t f = 0; f < fields.size(); ++f)
+    {
+        std::memset(&table[f], 0, sizeof(mapped_field));
+        if (std::strlen(fields[f].name) >= sizeof(table[f].name))
+            throw std::runtime_error("save: the field name " + std::string(fields[f].name) + " is too long");
+        std::strcpy(table[f].name, fields[f].name);
+        table[f].value_size = fields[f].value_size;
+        table[f].offset = offset;
+        offset = mapped_align(offset + header.ncells*fields[f].value_size);
+    }
+    header.file_size = offset;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::runtime_error("save: cannot open " + path);
+    mapped_write(file, &header, 1);
+    mapped_pad(file, header.bounds_offset);
+    mapped_write(file, bounds.data(), nslots);
+    mapped_pad(file, header.ranks_offset);
+    mapped_write(file, ranks.data(), nslots + 1);
+    mapped_pad(file, header.cells_offset);
+    for (auto const& slot : collection)
+        mapped_write(file, slot.data(), slot.size());
+    mapped_pad(file, header.fields_offset);
+    mapped_write(file, table.data(), table.size());
+    for (std::size_t f = 0; f < fields.size(); ++f)
+    {
+        mapped_pad(file, table[f].offset);
+        mapped_write(file, static_cast<char const*>(fields[f].data), header.ncells*fields[f].value_size);
+    }
+    mapped_pad(file, header.file_size);
+    if (!file)
+        throw std::runtime_error("save: cannot write " + path);
+}
+
+//! write a collection in a binary file (see MappedCollection).
+template<std::size_t dim, typename TValue>
+void save(std::string const& path, slotCollection<dim, TValue> const& collection)
+{
+    save_mapped(path, collection, {});
+}
+
+//! write a collection and the fields of its cells in a binary file.
+//! \note the fields must have been remapped on the current cells (see
+//! slotCollection::finalize).
+template<std::size_t dim, typename TValue, typename... TFields>
+void save(std::string const& path, slotCollection<dim, TValue> const& collection,
+          CellFields<slotCollection<dim, TValue>, TFields...> const& fields)
+{
+    static_assert(mapped_trivial<typename TFields::type...>::value, "The values of the fields must be trivially copyable.");
+    if (fields.size() != collection.nbNodes())
+        throw std::runtime_error("save: the fields do not match the cells of the collection");
+    save_mapped(path, collection,
+                {mapped_array{TFields::name(), sizeof(typename TFields::type),
+                              static_cast<void const*>(fields.template data<TFields>())}...});
+}
+
+//! map a whole file, read-only.
+//! \param length the size of the file.
+//! \note throws std::runtime_error if the file cannot be mapped (an empty
+//! file cannot be mapped).
+inline char const* mapped_map(std::string const& path, std::size_t& length)
+{
+#if defined(_WIN32)
+    HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("MappedCollection: cannot open " + path);
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        ::CloseHandle(file);
+        throw std::runtime_error("MappedCollection: " + path + " is not a collection file");
+    }
+    length = static_cast<std::size_t>(size.QuadPart);
+    HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    ::CloseHandle(file);
+    if (mapping == nullptr)
+        throw std::runtime_error("MappedCollection: cannot map " + path);
+    void* p = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle(mapping);     // the view keeps the mapping
+    if (p == nullptr)
+        throw std::runtime_error("MappedCollection: cannot map " + path);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("MappedCollection: cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("MappedCollection: " + path + " is not a collection file");
+    }
+    length = static_cast<std::size_t>(st.st_size);
+    void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        throw std::runtime_error("MappedCollection: cannot map " + path);
+#endif
+    return static_cast<char const*>(p);
+}
+
+//! unmap a file mapped by mapped_map.
+inline void mapped_unmap(char const* base, std::size_t length)
+{
+#if defined(_WIN32)
+    (void)length;
+    ::UnmapViewOfFile(base);
+#else
+    ::munmap(const_cast<char*>(base), length);
+#endif
+}
+
+//! residency hints on the pages of a mapping (see mapped_advise).
+enum class mapped_hint
+{
+    random,     //!< no read-ahead.
+    willneed,   //!< read the pages in the background.
+    dontneed,   //!< drop the pages (read back from the file if accessed).
+};
+
+//! size of a page of the mappings.
+inline std::size_t mapped_page_size()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+}
+
+//! give a residency hint on the pages [first, first + size[ of a mapping
+//! (whole pages). A hint without equivalent on the system is ignored.
+inline void mapped_advise(char const* first, std::size_t size, mapped_hint hint)
+{
+#if defined(_WIN32)
+    void* p = const_cast<char*>(first);
+    if (hint == mapped_hint::dontneed)
+        ::VirtualUnlock(p, size);   // unlocked pages leave the working set
+#if _WIN32_WINNT >= 0x0602
+    else if (hint == mapped_hint::willneed)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range{p, size};
+        ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+    }
+#endif
+#else
+    const int advice = (hint == mapped_hint::random) ? MADV_RANDOM
+                     : (hint == mapped_hint::willneed) ? MADV_WILLNEED
+                     : MADV_DONTNEED;
+    ::madvise(const_cast<char*>(first), size, advice);
+#endif
+}
+
+//! read-only collection of slots mapped from a file written by save.
+template < std::size_t dim, typename TValue = std::size_t >
+class MappedCollection
+{
+public:
+    using cell_type = Cell<dim, TValue>;
+    using slot_type = SlotView<cell_type>;
+    using definition = definitions<dim, TValue>;
+
+    //! map a file and check its header.
+    //! \note throws std::runtime_error if the file cannot be mapped, or
+    //! was not written by save with the same dim and TValue.
+    explicit MappedCollection(std::string const& path)
+    {
+        base = mapped_map(path, length);
+        try
+        {
+            check(path);
+        }
+        catch (...)
+        {
+            unmap();
+            throw;
+        }
+    }
+
+    MappedCollection(MappedCollection const&) = delete;
+    MappedCollection& operator=(MappedCollection const&) = delete;
+
+    MappedCollection(MappedCollection&& other)
+        : base{other.base}, length{other.length}
+    {
+        other.base = nullptr;
+        other.length = 0;
+    }
+
+    MappedCollection& operator=(MappedCollection&& other)
+    {
+        std::swap(base, other.base);
+        std::swap(length, other.length);
+        return *this;
+    }
+
+    ~MappedCollection()
+    {
+        unmap();
+    }
+
+    inline mapped_header const& header() const
+    {
+        return *reinterpret_cast<mapped_header const*>(base);
+    }
+
+    //! number of slots.
+    inline std::size_t size() const
+    {
+        return header().nslots;
+    }
+
+    //! number of cells stored.
+    inline std::size_t nbNodes() const
+    {
+        return header().ncells;
+    }
+
+    inline TValue s1(std::size_t i) const
+    {
+        return bounds()[i];
+    }
+
+    inline TValue s2(std::size_t i) const
+    {
+        return (i + 1 < size()) ? bounds()[i+1]: static_cast<TValue>(definition::maskpos + 1);
+    }
+
+    //! rank of the first cell of the slot i in the whole collection.
+    inline std::size_t startRank(std::size_t i) const
+    {
+        return ranks()[i];
+    }
+
+    //! the cells of the slot i (in the file).
+    inline slot_type operator[](std::size_t i) const
+    {
+        return {s1(i), cells() + startRank(i), startRank(i+1) - startRank(i)};
+    }
+
+    //! all the cells, slot after slot.
+    inline cell_type const* cells() const
+    {
+        return reinterpret_cast<cell_type const*>(base + header().cells_offset);
+    }
+
+    //! slot whose interval contains the cell.
+    inline std::size_t findSlot(cell_type const& cell) const
+    {
+        const TValue pos = static_cast<TValue>(cell.value&definition::maskpos);
+        return static_cast<std::size_t>(std::upper_bound(bounds(), bounds() + size(), pos) - bounds()) - 1;
+    }
+
+    inline std::size_t count(cell_type const& cell) const
+    {
+        auto const slot = (*this)[findSlot(cell)];
+        return slot.findChild(cell) == slot.cend() ? 0: 1;
+    }
+
+    //! the values of a field (nbNodes() values, by rank), or nullptr if
+    //! the file has no field of this name.
+    template<typename TField>
+    typename TField::type const* field() const
+    {
+        auto const* table = reinterpret_cast<mapped_field const*>(base + header().fields_offset);
+        for (std::size_t f = 0; f < header().nfields; ++f)
+            if (std::strcmp(table[f].name, TField::name()) == 0)
+            {
+                if (table[f].value_size != sizeof(typename TField::type))
+                    throw std::runtime_error(std::string("MappedCollection: wrong size of the field ") + TField::name());
+                return reinterpret_cast<typename TField::type const*>(base + table[f].offset);
+            }
+        return nullptr;
+    }
+
+    //! a copy of the slots in a slotCollection.
+    slotCollection<dim, TValue> load() const
+    {
+        PackCollection<dim, TValue> packs{0, size()};
+        for (std::size_t i = 0; i < size(); ++i)
+        {
+            auto const slot = (*this)[i];
+            CellPack<dim, TValue> pack{slot.value, std::max<std::size_t>(slot.size(), header().slot_max_size + 1)};
+            pack.insert(pack.end(), slot.cbegin(), slot.cend());
+            packs.push_back(std::move(pack));
+        }
+        return {std::move(packs), header().slot_min_size, header().slot_max_size};
+    }
+
+private:
+    char const* base = nullptr;
+    std::size_t length = 0;
+
+    inline TValue const* bounds() const
+    {
+        return reinterpret_cast<TValue const*>(base + header().bounds_offset);
+    }
+
+    inline std::uint64_t const* ranks() const
+    {
+        return reinterpret_cast<std::uint64_t const*>(base + header().ranks_offset);
+    }
+
+    void unmap()
+    {
+        if (base)
+            mapped_unmap(base, length);
+        base = nullptr;
+    }
+
+    //! check the header, that the arrays are in the file, and that the
+    //! slots are consistent (O(nslots), the cells are not read).
+    void check(std::string const& path) const
+    {
+        auto fail = [&](char const* what)
+        {
+            throw std::runtime_error("MappedCollection: " + path + ": " + what);
+        };
+        // count values of size bytes from offset, without overflow.
+        auto in_file = [&](std::uint64_t offset, std::uint64_t count, std::uint64_t size)
+        {
+            return offset%mapped_alignment == 0 && offset <= length
+                   && (size == 0 || count <= (length - offset)/size);
+        };
+
+        if (length < sizeof(mapped_header))
+            fail("not a collection file");
+        mapped_header const& h = header();
+        if (std::memcmp(h.magic, "ZCODESC", 8) != 0)
+            fail("not a collection file");
+        if (h.version != mapped_version)
+            fail("unsupported version");
+        if (h.byte_order != 0x01020304)
+            fail("written with another byte order");
+        if (h.dim != dim || h.value_size != sizeof(TValue))
+            fail("written for another dimension or value type");
+        if (h.file_size != length
+            || !in_file(h.bounds_offset, h.nslots, sizeof(TValue))
+            || !in_file(h.ranks_offset, h.nslots + 1, sizeof(std::uint64_t))
+            || !in_file(h.cells_offset, h.ncells, sizeof(TValue))
+            || !in_file(h.fields_offset, h.nfields, sizeof(mapped_field)))
+            fail("truncated");
+
+        if (h.nslots == 0 || ranks()[0] != 0 || ranks()[h.nslots] != h.ncells)
+            fail("inconsistent slot ranks");
+        for (std::size_t i = 0; i < h.nslots; ++i)
+            if (ranks()[i+1] < ranks()[i])
+                fail("inconsistent slot ranks");
+        if (bounds()[0] != 0)
+            fail("inconsistent slot bounds");
+        for (std::size_t i = 1; i < h.nslots; ++i)
+            if (bounds()[i] <= bounds()[i-1])
+                fail("inconsistent slot bounds");
+
+        auto const* table = reinterpret_cast<mapped_field const*>(base + h.fields_offset);
+        for (std::size_t f = 0; f < h.nfields; ++f)
+        {
+            if (std::memchr(table[f].name, 0, sizeof(table[f].name)) == nullptr)
+                fail("invalid field name");
+            if (!in_file(table[f].offset, h.ncells, table[f].value_size))
+                fail("truncated");
+        }
+    }
+};
@@ -0,0 +1,293 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <tree/node/cell.hpp>
+#include <tree/slot/cache.hpp>
+#include <tree/slot/mapped.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Read-only collection of slots larger than the memory, kept in a file
+/// written by save (see mapped.hpp) and mapped.
+///
+/// The slots are views on the mapping (SlotView), so that a slot is
+/// always readable: only its pages come and go. The collection keeps at
+/// most budget bytes of slots resident:
+///  - a slot becomes resident when it is accessed (operator[], count,
+///    or a miss of a Cache),
+///  - when the budget is passed, a CLOCK over the resident slots (a
+///    reference bit by slot, set at each access, the hits of a Cache
+///    included) chooses the slots to evict, whose pages are dropped
+///    (madvise DONTNEED) and read back from the file at the next access,
+///  - an access to the slot following the last one accessed (a Morton
+///    traversal) asks the kernel to read the next slots in the
+///    background (madvise WILLNEED), without waiting for them.
+/// The kernel read-ahead is disabled on the cells (madvise RANDOM): the
+/// prefetch above replaces it. On Windows, the pages are dropped from the
+/// working set (VirtualUnlock) and prefetched by PrefetchVirtualMemory
+/// (see mapped_advise).
+///
+/// The pages dropped stay in the page cache of the kernel, which can
+/// reclaim them: on a tmpfs file (e.g. /dev/shm) the whole file stays
+/// in memory. The fields of the file are not counted in the budget.
+///
+///  save("/scratch/tree.zc", collection);
+///  OutOfCoreCollection<3> ooc{"/scratch/tree.zc", std::size_t{8} << 30};
+///  for (std::size_t i = 0; i < ooc.size(); ++i)
+///      for (auto const& cell : ooc[i]) ...
+///
+/// \note not thread safe (the residency is updated at each access).
+///
+/// \brief out-of-core collection of slots with a residency budget.
+////////////////////////////////////////////////////////////////////////
+
+template < std::size_t dim, typename TValue = std::size_t >
+class OutOfCoreCollection
+{
+public:
+    using cell_type = Cell<dim, TValue>;
+    using slot_type = SlotView<cell_type>;
+    using definition = definitions<dim, TValue>;
+    template<std::size_t cache_size>
+    using cache_type = Cache<dim, TValue, cache_size, slot_type>;
+
+    //! \param path file written by save.
+    //! \param _budget bytes of slots kept resident.
+    //! \param _prefetch number of slots read ahead in a traversal.
+    OutOfCoreCollection(std::string const& path, std::size_t _budget, std::size_t _prefetch = 2)
+        : mapped{path},
+          budget{_budget},
+          prefetch{_prefetch},
+          page_size{mapped_page_size()},
+          referenced(mapped.size(), 0),
+          resident(mapped.size(), 0)
+    {
+        views.reserve(mapped.size());
+        for (std::size_t i = 0; i < mapped.size(); ++i)
+            views.push_back(mapped[i]);
+        advise(0, mapped.nbNodes(), mapped_hint::random);
+    }
+
+    OutOfCoreCollection(OutOfCoreCollection const&) = delete;
+    OutOfCoreCollection& operator=(OutOfCoreCollection const&) = delete;
+
+    //! number of slots.
+    inline std::size_t size() const
+    {
+        return views.size();
+    }
+
+    //! number of cells stored.
+    inline std::size_t nbNodes() const
+    {
+        return mapped.nbNodes();
+    }
+
+    inline TValue s1(std::size_t i) const
+    {
+        return mapped.s1(i);
+    }
+
+    inline TValue s2(std::size_t i) const
+    {
+        return mapped.s2(i);
+    }
+
+    inline std::size_t startRank(std::size_t i) const
+    {
+        return mapped.startRank(i);
+    }
+
+    inline std::size_t findSlot(cell_type const& cell) const
+    {
+        return mapped.findSlot(cell);
+    }
+
+    //! the slots never change (see Cache).
+    inline std::size_t epoch() const
+    {
+        return 1;
+    }
+
+    //! the slot i, made resident.
+    inline slot_type const& operator[](std::size_t i) const
+    {
+        access(i);
+        return views[i];
+    }
+
+    //! number of stored cells equal to cell (0 or 1).
+    inline std::size_t count(cell_type const& cell) const
+    {
+        auto const& slot = (*this)[findSlot(cell)];
+        return slot.findChild(cell) == slot.cend() ? 0 : 1;
+    }
+
+    //! number of stored cells equal to cell (0 or 1), looking for its slot
+    //! in a cache.
+    template<std::size_t cache_size>
+    inline std::size_t count(cell_type const& cell, cache_type<cache_size>& cache) const
+    {
+        auto const& slot = (*this)[cache.find(*this, cell)];
+        auto it = slot.findChild(cell);
+        cache.setrankInSlot(std::distance(slot.cbegin(), it));
+        return it == slot.cend() ? 0 : 1;
+    }
+
+    //! the values of a field (see MappedCollection::field).
+    template<typename TField>
+    inline typename TField::type const* field() const
+    {
+        return mapped.template field<TField>();
+    }
+
+    //! a copy of the slots in a slotCollection (must fit in memory).
+    inline slotCollection<dim, TValue> load() const
+    {
+        return mapped.load();
+    }
+
+    //! bytes of the resident slots.
+    inline std::size_t residentBytes() const
+    {
+        return resident_bytes;
+    }
+
+    //! number of resident slots.
+    inline std::size_t nbResident() const
+    {
+        return static_cast<std::size_t>(std::count(resident.cbegin(), resident.cend(), 1));
+    }
+
+    inline std::size_t budgetBytes() const
+    {
+        return budget;
+    }
+
+    //! slots made resident by an access (not prefetched).
+    inline std::size_t nbLoads() const
+    {
+        return nloads;
+    }
+
+    //! slots made resident by a prefetch.
+    inline std::size_t nbPrefetches() const
+    {
+        return nprefetches;
+    }
+
+    inline std::size_t nbEvictions() const
+    {
+        return nevictions;
+    }
+
+    //! drop all the slots.
+    void evictAll()
+    {
+        for (std::size_t i = 0; i < size(); ++i)
+            if (resident[i])
+                evict(i);
+    }
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    MappedCollection<dim, TValue> mapped;
+    std::vector<slot_type> views;
+    std::size_t budget;
+    std::size_t prefetch;
+    std::size_t page_size;
+
+    // residency, updated by the const accesses
+    mutable std::vector<unsigned char> referenced;   //!< CLOCK bits.
+    mutable std::vector<unsigned char> resident;
+    mutable std::size_t resident_bytes = 0;
+    mutable std::size_t hand = 0;
+    mutable std::size_t last = npos;                 //!< last slot accessed.
+    mutable std::size_t nloads = 0, nprefetches = 0, nevictions = 0;
+
+    inline std::size_t bytes(std::size_t i) const
+    {
+        return views[i].size()*sizeof(cell_type);
+    }
+
+    //! hint on the pages of the cells [first, last[: the pages touching
+    //! them, or only the pages inside them for dontneed (the pages shared
+    //! with other slots are not dropped).
+    void advise(std::size_t first_rank, std::size_t last_rank, mapped_hint hint) const
+    {
+        auto const begin = reinterpret_cast<std::uintptr_t>(mapped.cells() + first_rank);
+        auto const end = reinterpret_cast<std::uintptr_t>(mapped.cells() + last_rank);
+        const std::uintptr_t page_begin = (hint == mapped_hint::dontneed) ? (begin + page_size - 1)/page_size*page_size
+                                                                          : begin/page_size*page_size;
+        const std::uintptr_t page_end = (hint == mapped_hint::dontneed) ? end/page_size*page_size
+                                                                        : (end + page_size - 1)/page_size*page_size;
+        if (page_begin < page_end)
+            mapped_advise(reinterpret_cast<char const*>(page_begin), page_end - page_begin, hint);
+    }
+
+    //! mark a slot as used, and make the slots which follow a traversal
+    //! resident.
+    void access(std::size_t i) const
+    {
+        referenced[i] = 1;
+        if (!resident[i])
+        {
+            ++nloads;
+            make_resident(i);
+        }
+        if (last != npos && i == last + 1)
+            for (std::size_t j = i + 1; j < std::min(size(), i + 1 + prefetch); ++j)
+                if (!resident[j])
+                {
+                    // the prefetch does not evict.
+                    if (resident_bytes + bytes(j) > budget)
+                        break;
+                    ++nprefetches;
+                    advise(startRank(j), startRank(j+1), mapped_hint::willneed);
+                    referenced[j] = 1;
+                    make_resident(j);
+                }
+        last = i;
+    }
+
+    void make_resident(std::size_t i) const
+    {
+        resident[i] = 1;
+        resident_bytes += bytes(i);
+        shrink(i);
+    }
+
+    //! evict slots (CLOCK) until the budget is met, keeping the slot i.
+    void shrink(std::size_t i) const
+    {
+        // two turns: the first one may only clear the reference bits.
+        for (std::size_t steps = 0; resident_bytes > budget && steps < 2*size(); ++steps)
+        {
+            const std::size_t j = hand;
+            hand = (hand + 1)%size();
+            if (!resident[j] || j == i)
+                continue;
+            if (referenced[j])
+                referenced[j] = 0;
+            else
+                evict(j);
+        }
+    }
+
+    void evict(std::size_t j) const
+    {
+        advise(startRank(j), startRank(j+1), mapped_hint::dontneed);
+        resident[j] = 0;
+        referenced[j] = 0;
+        resident_bytes -= bytes(j);
+        ++nevictions;
+    }
+};
+
+template<std::size_t dim, typename TValue>
+constexpr std::size_t OutOfCoreCollection<dim, TValue>::npos;
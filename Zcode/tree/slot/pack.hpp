@@ -1,10 +1,65 @@
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 #include <tree/node/cell.hpp>
 #include <tree/slot/slot.hpp>
 
 template<std::size_t dim, typename TValue = std::size_t>
 using CellPack = Slot<Cell<dim, TValue>>;
 
+//! pack whose cells stay sorted (see SortedChildren).
 template<std::size_t dim, typename TValue = std::size_t>
-using PackCollection = Slot<CellPack<dim, TValue>>;
\ No newline at end of file
+using SortedCellPack = Slot<Cell<dim, TValue>, SortedChildren>;
+
+template<std::size_t dim, typename TValue = std::size_t>
+using PackCollection = Slot<CellPack<dim, TValue>>;
+
+//! cut a sorted pack in a collection of packs of at most pack_size cells.
+//! \note the value of each pack is its first cell, without the free bits.
+template<std::size_t dim, typename TValue>
+PackCollection<dim, TValue> split(CellPack<dim, TValue> const& pack, std::size_t pack_size)
+{
+    using definition = definitions<dim, TValue>;
+    const std::size_t npacks = (pack.size() + pack_size - 1)/pack_size;
+
+    std::vector<CellPack<dim, TValue>> packs(npacks, CellPack<dim, TValue>{0, 0});
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, npacks), [&](auto const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+        {
+            auto first = pack.cbegin() + i*pack_size;
+            auto last = pack.cbegin() + std::min(pack.size(), (i+1)*pack_size);
+            packs[i].value = first->value&definition::partWithoutFreeBits;
+            packs[i].reserve(pack_size);
+            packs[i].insert(packs[i].end(), first, last);
+        }
+    });
+
+    PackCollection<dim, TValue> collection{0, npacks};
+    for (auto& p : packs)
+        collection.push_back(std::move(p));
+    return collection;
+}
+
+//! gather all the cells of a collection in one pack.
+template<std::size_t dim, typename TValue>
+CellPack<dim, TValue> flatten(PackCollection<dim, TValue> const& collection)
+{
+    std::vector<std::size_t> start(collection.size() + 1, 0);
+    for (std::size_t i = 0; i < collection.size(); ++i)
+        start[i+1] = start[i] + collection[i].size();
+
+    CellPack<dim, TValue> pack{collection.value, start.back()};
+    pack.resize(start.back());
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, collection.size()), [&](auto const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+            std::copy(collection[i].cbegin(), collection[i].cend(), pack.begin() + start[i]);
+    });
+    return pack;
+}
@@ -0,0 +1,275 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <tbb/spin_mutex.h>
+
+#include <tree/node/cell.hpp>
+#include <tree/slot/slot.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Memory pool shared by the slots of a collection.
+///
+/// The blocks are cut in large chunks (bump allocation) and rounded up
+/// to a power of two bytes (the size classes). A freed block goes in the
+/// free list of its class and is given back to the next allocation of
+/// the same class, so that once a computation has reached its steady
+/// state (the slots are refined and coarsened around the same sizes),
+/// it does not call malloc any more. The blocks larger than a quarter of
+/// a chunk are directly allocated.
+///
+/// The chunks are only freed:
+///  - all at once by release(), when no slot uses the pool any more,
+///  - all at once by clear(packs), which destroys the packs without
+///    filling the free lists,
+///  - by compact(packs), which copies the slots in new chunks and frees
+///    the old ones (the free lists are then empty: call it after a
+///    coarsening which left many blocks unused).
+///
+/// Each size class has its own lock, so that the slots of a collection
+/// can grow in parallel.
+///
+/// Use it like:
+///
+///  SlotPool pool;
+///  using pack_type = PooledCellPack<3>;
+///  Slot<pack_type> packs{0, n};
+///  packs.push_back(pack_type{s1, 1024, PoolAllocator<Cell<3>>{pool}});
+///
+/// \brief size-class pool for the children of slots.
+////////////////////////////////////////////////////////////////////////
+
+class SlotPool
+{
+public:
+    //! size of the smallest class.
+    static constexpr std::size_t min_block = 64;
+    //! number of size classes.
+    static constexpr std::size_t nclasses = 32;
+
+    //! \param _chunk_size size of the chunks (in bytes).
+    explicit SlotPool(std::size_t _chunk_size = std::size_t{1} << 20)
+        : chunk_size{std::max(_chunk_size, 4*min_block)}
+    {
+        free_lists.fill(nullptr);
+    }
+
+    SlotPool(SlotPool const&) = delete;
+    SlotPool& operator=(SlotPool const&) = delete;
+
+    ~SlotPool()
+    {
+        release();
+    }
+
+    void* allocate(std::size_t bytes)
+    {
+        if (bytes > max_block())
+            return ::operator new(bytes);
+
+        const std::size_t c = size_class(bytes);
+        {
+            std::lock_guard<tbb::spin_mutex> lock{class_mutex[c]};
+            if (free_lists[c])
+            {
+                free_block* block = free_lists[c];
+                free_lists[c] = block->next;
+                return block;
+            }
+        }
+        return carve(min_block << c);
+    }
+
+    void deallocate(void* p, std::size_t bytes)
+    {
+        if (bytes > max_block())
+        {
+            ::operator delete(p);
+            return;
+        }
+        // the blocks of the chunks about to be freed are dropped.
+        if (dropping || (!old_chunks.empty() && in_old_chunk(p)))
+            return;
+        push_free(p, size_class(bytes));
+    }
+
+    //! free all the chunks at once.
+    //! \note no slot must use the pool any more.
+    void release()
+    {
+        for (void* chunk : chunks)
+            ::operator delete(chunk);
+        chunks.clear();
+        free_lists.fill(nullptr);
+        top = last = nullptr;
+    }
+
+    //! destroy the packs and free all the chunks at once.
+    //! \param packs container of all the slots allocated in this pool.
+    //! \note not thread safe.
+    template<typename TPacks>
+    void clear(TPacks& packs)
+    {
+        dropping = true;
+        packs.erase(packs.begin(), packs.end());
+        dropping = false;
+        release();
+    }
+
+    //! copy the children of each pack in new chunks and free the old ones.
+    //! \param packs container of slots allocated in this pool.
+    //! \note not thread safe.
+    template<typename TPacks>
+    void compact(TPacks& packs)
+    {
+        old_chunks.swap(chunks);
+        std::sort(old_chunks.begin(), old_chunks.end());
+        free_lists.fill(nullptr);
+        top = last = nullptr;
+
+        for (auto& pack : packs)
+        {
+            using pack_type = typename std::decay<decltype(pack)>::type;
+            pack_type copy{pack.value, pack.capacity(), pack.get_allocator()};
+            copy.insert(copy.end(), pack.cbegin(), pack.cend());
+            pack = std::move(copy);
+        }
+
+        for (void* chunk : old_chunks)
+            ::operator delete(chunk);
+        old_chunks.clear();
+    }
+
+    //! number of chunks allocated.
+    inline std::size_t nbChunks() const
+    {
+        return chunks.size();
+    }
+
+    //! bytes allocated in chunks.
+    inline std::size_t reserved() const
+    {
+        return chunks.size()*chunk_size;
+    }
+
+private:
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    std::size_t chunk_size;
+    std::vector<void*> chunks;
+    std::vector<void*> old_chunks;        //!< sorted, only during compact.
+    bool dropping = false;                //!< during clear.
+    char* top = nullptr;                  //!< free part of the last chunk.
+    char* last = nullptr;
+    tbb::spin_mutex chunk_mutex;
+    std::array<free_block*, nclasses> free_lists;
+    std::array<tbb::spin_mutex, nclasses> class_mutex;
+
+    inline std::size_t max_block() const
+    {
+        return std::min(chunk_size/4, min_block << (nclasses - 1));
+    }
+
+    //! smallest class whose blocks hold bytes.
+    static inline std::size_t size_class(std::size_t bytes)
+    {
+        std::size_t c = 0;
+        while ((min_block << c) < bytes)
+            ++c;
+        return c;
+    }
+
+    inline void push_free(void* p, std::size_t c)
+    {
+        std::lock_guard<tbb::spin_mutex> lock{class_mutex[c]};
+        free_block* block = static_cast<free_block*>(p);
+        block->next = free_lists[c];
+        free_lists[c] = block;
+    }
+
+    //! a new block cut in the last chunk.
+    void* carve(std::size_t bytes)
+    {
+        std::lock_guard<tbb::spin_mutex> lock{chunk_mutex};
+        if (static_cast<std::size_t>(last - top) < bytes)
+        {
+            // the end of the chunk goes in the free lists.
+            for (std::size_t c = nclasses; c-- > 0;)
+                while (static_cast<std::size_t>(last - top) >= (min_block << c))
+                {
+                    push_free(top, c);
+                    top += min_block << c;
+                }
+            chunks.push_back(::operator new(chunk_size));
+            top = static_cast<char*>(chunks.back());
+            last = top + chunk_size;
+        }
+        void* block = top;
+        top += bytes;
+        return block;
+    }
+
+    inline bool in_old_chunk(void* p) const
+    {
+        auto it = std::upper_bound(old_chunks.cbegin(), old_chunks.cend(), p, std::less<void*>{});
+        return it != old_chunks.cbegin() && std::less<void*>{}(p, static_cast<char*>(*(it-1)) + chunk_size);
+    }
+};
+
+//! allocator of the children of slots in a SlotPool.
+template<typename T>
+struct PoolAllocator
+{
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    SlotPool* pool;
+
+    PoolAllocator(SlotPool& _pool)
+        : pool{&_pool}
+    {}
+
+    template<typename U>
+    PoolAllocator(PoolAllocator<U> const& other)
+        : pool{other.pool}
+    {}
+
+    inline T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(pool->allocate(n*sizeof(T)));
+    }
+
+    inline void deallocate(T* p, std::size_t n)
+    {
+        pool->deallocate(p, n*sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+inline bool operator==(PoolAllocator<T> const& a, PoolAllocator<U> const& b)
+{
+    return a.pool == b.pool;
+}
+
+template<typename T, typename U>
+inline bool operator!=(PoolAllocator<T> const& a, PoolAllocator<U> const& b)
+{
+    return a.pool != b.pool;
+}
+
+//! pack of cells allocated in a SlotPool.
+template<std::size_t dim, typename TValue = std::size_t>
+using PooledCellPack = Slot<Cell<dim, TValue>, UnsortedChildren, PoolAllocator<Cell<dim, TValue>>>;
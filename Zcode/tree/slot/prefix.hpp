@@ -0,0 +1,403 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/znode.hpp>
+#include <tree/slot/pack.hpp>
+#include <tree/slot/slot.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Pack of cells sharing a prefix, stored once.
+///
+/// The cells of a pack covering a small Morton interval at one level
+/// have the same level and the same upper position bits. The pack keeps
+/// them in its value (the prefix), and stores for each cell only a
+/// suffix of 16 or 32 bits: the lower position bits of its level (its
+/// position shifted by dim*(nlevels-1-level), see level_shift), then its
+/// 5 free bits.
+///
+///  suffix_bits = 8*sizeof(TSuffix) - 5 (11 or 27, at most dim*nlevels)
+///
+/// so that a pack of level l covers 2^suffix_bits cells of this level,
+/// whatever l (the whole level when dim*(l+1) <= suffix_bits).
+///
+/// A pack of 32 bits suffixes is 2 (64 bits values) or 4 (128 bits
+/// values) times smaller than a CellPack, and a cache line holds as many
+/// times more cells for the neighbor scans. The iterators rebuild the
+/// cells on the fly.
+///
+/// Only the cells with the same prefix can be stored (see fits):
+///
+///  PrefixPack<3> pack{cell.value, n};
+///  if (pack.fits(other))
+///      pack.push_back(other);
+///
+/// \brief pack of cells stored by their suffixes.
+////////////////////////////////////////////////////////////////////////
+
+template < std::size_t dim, typename TValue = std::size_t, typename TSuffix = std::uint32_t >
+class PrefixPack
+    : public ZNode< PrefixPack<dim, TValue, TSuffix>, dim, TValue >
+{
+public:
+    using znode_type = ZNode< PrefixPack<dim, TValue, TSuffix>, dim, TValue >;
+    using znode_type::value;
+    using zvalue_type = TValue;
+    using suffix_type = TSuffix;
+    using cell_type = Cell<dim, TValue>;
+    using children_type = cell_type;
+    using definition = definitions<dim, TValue>;
+
+    static_assert(std::is_unsigned<TSuffix>::value && 8*sizeof(TSuffix) > definition::nbfreebits,
+                  "The suffixes must be unsigned and hold the free bits.");
+
+    //! number of position bits in a suffix.
+    static constexpr std::size_t suffix_bits = std::min<std::size_t>(8*sizeof(TSuffix) - definition::nbfreebits,
+                                                                     dim*definition::nlevels);
+    //! position bits of a suffix (position of a cell shifted to its level).
+    static constexpr TValue suffix_mask = static_cast<TValue>((TValue{1} << suffix_bits) - 1);
+
+    //! shift of the position bits of a level.
+    static inline std::size_t level_shift(std::size_t level)
+    {
+        return dim*(definition::nlevels - 1 - level);
+    }
+
+    //! bits of a value of a level stored in the prefix (upper position
+    //! bits and level).
+    static inline TValue prefix_mask(std::size_t level)
+    {
+        const std::size_t low = level_shift(level) + suffix_bits;
+        const TValue upper = (low >= dim*definition::nlevels) ? TValue{0}
+                                                              : static_cast<TValue>(definition::maskpos >> low << low);
+        return static_cast<TValue>(upper | definition::levelzone);
+    }
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = cell_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = cell_type const*;
+        using reference = cell_type;
+
+        const_iterator() = default;
+
+        const_iterator(TSuffix const* _p, TValue _prefix)
+            : p{_p}, prefix{_prefix}
+        {}
+
+        inline cell_type operator*() const
+        {
+            return cell_type{expand(prefix, *p)};
+        }
+
+        inline cell_type operator[](difference_type n) const
+        {
+            return cell_type{expand(prefix, p[n])};
+        }
+
+        //! the stored suffix.
+        inline TSuffix suffix() const
+        {
+            return *p;
+        }
+
+        inline const_iterator& operator++()
+        {
+            ++p;
+            return *this;
+        }
+
+        inline const_iterator operator++(int)
+        {
+            return {p++, prefix};
+        }
+
+        inline const_iterator& operator--()
+        {
+            --p;
+            return *this;
+        }
+
+        inline const_iterator operator--(int)
+        {
+            return {p--, prefix};
+        }
+
+        inline const_iterator& operator+=(difference_type n)
+        {
+            p += n;
+            return *this;
+        }
+
+        inline const_iterator& operator-=(difference_type n)
+        {
+            p -= n;
+            return *this;
+        }
+
+        inline const_iterator operator+(difference_type n) const
+        {
+            return {p + n, prefix};
+        }
+
+        inline const_iterator operator-(difference_type n) const
+        {
+            return {p - n, prefix};
+        }
+
+        inline difference_type operator-(const_iterator const& other) const
+        {
+            return p - other.p;
+        }
+
+        inline bool operator==(const_iterator const& other) const
+        {
+            return p == other.p;
+        }
+
+        inline bool operator!=(const_iterator const& other) const
+        {
+            return p != other.p;
+        }
+
+        inline bool operator<(const_iterator const& other) const
+        {
+            return p < other.p;
+        }
+
+    private:
+        TSuffix const* p = nullptr;
+        TValue prefix = 0;
+    };
+
+    //! \param v a value with the prefix of the cells (the other bits are ignored).
+    //! \param size capacity.
+    PrefixPack( zvalue_type v = 0, std::size_t size = 10 )
+        : znode_type{static_cast<TValue>(v&prefix_mask(level_of(v)))}
+    {
+        suffixes.reserve(size);
+    }
+
+    //! factor the cells of a slot.
+    //! \note the cells must have the same prefix (see factorable).
+    template<typename TPolicy, typename TAllocator>
+    explicit PrefixPack(Slot<cell_type, TPolicy, TAllocator> const& pack)
+        : PrefixPack{pack.size() ? pack[0].value: pack.value, pack.size()}
+    {
+        for (auto const& cell : pack)
+            push_back(cell);
+    }
+
+    //! true if all the cells of a slot have the same prefix.
+    template<typename TPolicy, typename TAllocator>
+    static bool factorable(Slot<cell_type, TPolicy, TAllocator> const& pack)
+    {
+        if (pack.size() == 0)
+            return true;
+        const TValue mask = prefix_mask(level_of(pack[0].value));
+        return std::all_of(pack.cbegin(), pack.cend(), [&](auto const& cell)
+        {
+            return ((cell.value^pack[0].value)&mask) == 0;
+        });
+    }
+
+    //! true if the cell has the prefix of the pack.
+    inline bool fits(cell_type const& cell) const
+    {
+        return (cell.value&prefix_mask(level_of(value))) == prefix();
+    }
+
+    //! the prefix of the cells (the value without its tags).
+    inline TValue prefix() const
+    {
+        return static_cast<TValue>(value&prefix_mask(level_of(value)));
+    }
+
+    inline std::size_t size() const
+    {
+        return suffixes.size();
+    }
+
+    inline bool empty() const
+    {
+        return suffixes.empty();
+    }
+
+    inline std::size_t capacity() const
+    {
+        return suffixes.capacity();
+    }
+
+    inline void reserve(std::size_t n)
+    {
+        suffixes.reserve(n);
+    }
+
+    inline void clear()
+    {
+        suffixes.clear();
+    }
+
+    //! the suffixes (one by cell).
+    inline TSuffix const* data() const
+    {
+        return suffixes.data();
+    }
+
+    inline cell_type operator[](std::size_t k) const
+    {
+        return cell_type{expand(prefix(), suffixes[k])};
+    }
+
+    inline const_iterator begin() const
+    {
+        return {suffixes.data(), prefix()};
+    }
+
+    inline const_iterator end() const
+    {
+        return {suffixes.data() + suffixes.size(), prefix()};
+    }
+
+    inline const_iterator cbegin() const
+    {
+        return begin();
+    }
+
+    inline const_iterator cend() const
+    {
+        return end();
+    }
+
+    //! add a cell at the end.
+    //! \note the cell must fit in the pack (not checked in release).
+    inline void push_back(cell_type const& cell)
+    {
+        assert(fits(cell));
+        suffixes.push_back(suffix_of(cell.value));
+    }
+
+    //! remove the cells in [first, last[.
+    inline const_iterator erase(const_iterator first, const_iterator last)
+    {
+        auto it = suffixes.erase(suffixes.cbegin() + (first - cbegin()), suffixes.cbegin() + (last - cbegin()));
+        return begin() + (it - suffixes.begin());
+    }
+
+    //! find a cell (same value, tags included): a linear scan of the
+    //! suffixes.
+    inline const_iterator findChild(cell_type const& node) const
+    {
+        if (!fits(node))
+            return end();
+        const TSuffix s = suffix_of(node.value);
+        return begin() + (std::find(suffixes.cbegin(), suffixes.cend(), s) - suffixes.cbegin());
+    }
+
+    //! number of cells equal to node (tags included).
+    inline std::size_t count(cell_type const& node) const
+    {
+        if (!fits(node))
+            return 0;
+        return std::count(suffixes.cbegin(), suffixes.cend(), suffix_of(node.value));
+    }
+
+    //! sort the children by sortKey (stable): the cells have the same
+    //! level, so that the position bits of the suffixes are enough.
+    inline void sortChildren()
+    {
+        std::stable_sort(suffixes.begin(), suffixes.end(), [](TSuffix a, TSuffix b)
+        {
+            return (a&suffix_pos) < (b&suffix_pos);
+        });
+    }
+
+    /// Remove all the children that have the same tag
+    /// as given in parameter
+    inline void removeTaggedChildren(zvalue_type tag)
+    {
+        if (this->hasTags(tag))
+        {
+            const TSuffix t = tags_of(tag);
+            suffixes.erase(std::remove_if(suffixes.begin(), suffixes.end(), [&](TSuffix s)
+            {
+                return (s&suffix_tags) == t;
+            }), suffixes.end());
+        }
+        this->unsetTags(tag);
+    }
+
+    /// Remove all the children that have at least one bit
+    /// set to one in the freebitparts.
+    inline void removeTaggedChildren()
+    {
+        suffixes.erase(std::remove_if(suffixes.begin(), suffixes.end(), [](TSuffix s)
+        {
+            return (s&suffix_tags) != 0;
+        }), suffixes.end());
+        this->clearAllTags();
+    }
+
+    //! the cells in a CellPack.
+    CellPack<dim, TValue> expand() const
+    {
+        CellPack<dim, TValue> pack{value, size()};
+        pack.insert(pack.end(), cbegin(), cend());
+        return pack;
+    }
+
+private:
+    static constexpr std::size_t tag_shift = dim*definition::nlevels;
+    static constexpr TSuffix suffix_pos = static_cast<TSuffix>(suffix_mask);
+    static constexpr TSuffix suffix_tags = static_cast<TSuffix>(((TSuffix{1} << definition::nbfreebits) - 1) << suffix_bits);
+
+    std::vector<TSuffix> suffixes;
+
+    static inline std::size_t level_of(TValue v)
+    {
+        return static_cast<std::size_t>(v >> definition::levelshift);
+    }
+
+    static inline TSuffix tags_of(TValue v)
+    {
+        return static_cast<TSuffix>(static_cast<TSuffix>((v&definition::FreeBitsPart) >> tag_shift) << suffix_bits);
+    }
+
+    static inline TSuffix suffix_of(TValue v)
+    {
+        const TValue pos = static_cast<TValue>((v&definition::maskpos) >> level_shift(level_of(v)));
+        return static_cast<TSuffix>(static_cast<TSuffix>(pos&suffix_mask) | tags_of(v));
+    }
+
+    static inline TValue expand(TValue prefix, TSuffix s)
+    {
+        const TValue pos = static_cast<TValue>(static_cast<TValue>(s)&suffix_mask);
+        return static_cast<TValue>(prefix | static_cast<TValue>(pos << level_shift(level_of(prefix)))
+                                   | (static_cast<TValue>(s >> suffix_bits) << tag_shift));
+    }
+};
+
+template<std::size_t dim, typename TValue, typename TSuffix>
+constexpr std::size_t PrefixPack<dim, TValue, TSuffix>::suffix_bits;
+
+template<std::size_t dim, typename TValue, typename TSuffix>
+constexpr TValue PrefixPack<dim, TValue, TSuffix>::suffix_mask;
+
+template<std::size_t dim, typename TValue, typename TSuffix>
+constexpr std::size_t PrefixPack<dim, TValue, TSuffix>::tag_shift;
+
+template<std::size_t dim, typename TValue, typename TSuffix>
+constexpr TSuffix PrefixPack<dim, TValue, TSuffix>::suffix_pos;
+
+template<std::size_t dim, typename TValue, typename TSuffix>
+constexpr TSuffix PrefixPack<dim, TValue, TSuffix>::suffix_tags;
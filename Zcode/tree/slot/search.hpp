@@ -0,0 +1,221 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/family.hpp>
+#include <tree/node/neighbor.hpp>
+#include <tree/node/stencil.hpp>
+#include <tree/slot/build.hpp>
+#include <tree/slot/pack.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Neighbor search in an adaptive linear tree.
+///
+/// The neighbors given by a stencil are at the level of the cell, but
+/// in an adaptive tree the leaf at this place can be:
+///  - the same cell,
+///  - a coarser leaf containing it,
+///  - a set of finer leaves (the descendants of the candidate, which are
+///    contiguous in the sorted leaves).
+///
+/// Each candidate is resolved with one lower_bound on the positions of
+/// the leaves and a few isAncestor checks. The batched version handles
+/// a sorted pack of cells: the candidates of two consecutive cells are
+/// close in the leaves, so the search gallops from the previous result
+/// of the same stencil offset instead of doing a full binary search.
+///
+/// Use it like:
+///
+///  std::array<leaf_range, FaceStencil<3>::size> ranges;
+///  neighborLeaves<FaceStencil<3>>(leaves, cell, ranges);
+///  for (auto const& r : ranges)
+///      for (std::size_t i = r.first; i < r.last; ++i)
+///          ... leaves[i] ...
+///
+/// \brief neighbor leaves of different levels.
+////////////////////////////////////////////////////////////////////////
+
+//! how a candidate is covered by the leaves.
+enum class neighbor_kind
+{
+    none,    //!< outside of the domain or not in the leaves.
+    same,    //!< one leaf equal to the candidate.
+    coarser, //!< one leaf containing the candidate.
+    finer,   //!< several leaves contained in the candidate.
+};
+
+//! leaves [first, last[ covering a candidate.
+struct leaf_range
+{
+    std::size_t first = 0;
+    std::size_t last = 0;
+    neighbor_kind kind = neighbor_kind::none;
+};
+
+//! rank of the leaf containing the first finest cell of node.
+//! \param leaves a complete linear tree, sorted.
+template<std::size_t dim, typename TValue>
+inline std::size_t findLeaf(CellPack<dim, TValue> const& leaves, TValue node)
+{
+    using definition = definitions<dim, TValue>;
+    const TValue pos = node&definition::maskpos;
+    auto it = std::upper_bound(leaves.cbegin(), leaves.cend(), pos,
+                               [](TValue p, Cell<dim, TValue> const& c){return p < (c.value&definition::maskpos);});
+    return std::distance(leaves.cbegin(), it) - 1;
+}
+
+//! rank of the first leaf whose position is not less than pos, searched
+//! from hint by exponential steps.
+template<std::size_t dim, typename TValue>
+inline std::size_t gallop_lower_bound(CellPack<dim, TValue> const& leaves, TValue pos, std::size_t hint)
+{
+    using definition = definitions<dim, TValue>;
+    auto position = [&](std::size_t i){return leaves[i].value&definition::maskpos;};
+    const std::size_t size = leaves.size();
+
+    std::size_t lo = 0, hi = size;
+    hint = std::min(hint, size);
+    if (hint < size && position(hint) < pos)
+    {
+        std::size_t step = 1;
+        lo = hint + 1;
+        while (hint + step < size && position(hint + step) < pos)
+        {
+            lo = hint + step + 1;
+            step *= 2;
+        }
+        hi = std::min(hint + step, size);
+    }
+    else
+    {
+        std::size_t step = 1;
+        hi = hint;
+        while (step <= hint && position(hint - step) >= pos)
+        {
+            hi = hint - step;
+            step *= 2;
+        }
+        lo = (step <= hint) ? hint - step + 1: 0;
+    }
+    return std::lower_bound(leaves.cbegin() + lo, leaves.cbegin() + hi, pos,
+                            [](Cell<dim, TValue> const& c, TValue p){return (c.value&definition::maskpos) < p;})
+           - leaves.cbegin();
+}
+
+//! resolve a candidate knowing the first leaf not before its position.
+template<std::size_t dim, typename TValue>
+inline leaf_range resolve_candidate(CellPack<dim, TValue> const& leaves, Cell<dim, TValue> const& candidate, std::size_t rank)
+{
+    using definition = definitions<dim, TValue>;
+    leaf_range range;
+    const TValue pos = candidate.value&definition::maskpos;
+
+    if (rank < leaves.size() && (leaves[rank].value&definition::maskpos) == pos)
+    {
+        range.first = rank;
+        if (leaves[rank].level() == candidate.level())
+        {
+            range.kind = neighbor_kind::same;
+            range.last = rank + 1;
+        }
+        else if (leaves[rank].level() < candidate.level())
+        {
+            range.kind = neighbor_kind::coarser;
+            range.last = rank + 1;
+        }
+        else
+        {
+            range.kind = neighbor_kind::finer;
+            range.last = rank + 1;
+            while (range.last < leaves.size() && isAncestor(candidate, leaves[range.last]))
+                ++range.last;
+        }
+    }
+    else if (rank < leaves.size() && isAncestor(candidate, leaves[rank]))
+    {
+        // finer leaves, without the one at the first corner
+        range.kind = neighbor_kind::finer;
+        range.first = rank;
+        range.last = rank + 1;
+        while (range.last < leaves.size() && isAncestor(candidate, leaves[range.last]))
+            ++range.last;
+    }
+    else if (rank > 0 && isAncestor(leaves[rank-1], candidate))
+    {
+        range.kind = neighbor_kind::coarser;
+        range.first = rank - 1;
+        range.last = rank;
+    }
+    return range;
+}
+
+//! leaves covering a cell.
+//! \param leaves sorted leaves (a linear tree, not necessarily complete).
+template<std::size_t dim, typename TValue>
+inline leaf_range findLeaves(CellPack<dim, TValue> const& leaves, Cell<dim, TValue> const& candidate)
+{
+    using definition = definitions<dim, TValue>;
+    if (candidate.value&definition::voidbit)
+        return {};
+    const TValue pos = candidate.value&definition::maskpos;
+    const std::size_t rank = std::lower_bound(leaves.cbegin(), leaves.cend(), pos,
+                                              [](Cell<dim, TValue> const& c, TValue p){return (c.value&definition::maskpos) < p;})
+                             - leaves.cbegin();
+    return resolve_candidate(leaves, candidate, rank);
+}
+
+//! leaves covering the neighbors of a cell given by a stencil.
+//! \param leaves sorted leaves (a linear tree, not necessarily complete).
+//! \param ranges ranges[k] are the leaves of the k-th neighbor of the stencil.
+template<typename TStencil, std::size_t dim, typename TValue>
+void neighborLeaves(CellPack<dim, TValue> const& leaves, Cell<dim, TValue> const& cell,
+                    std::array<leaf_range, TStencil::size>& ranges)
+{
+    static_assert(TStencil::dim == dim, "The stencil dimension is not valid.");
+    std::array<TValue, TStencil::size> neighbors_array;
+    neighbors<TStencil>(cell, neighbors_array);
+    for (std::size_t k = 0; k < TStencil::size; ++k)
+        ranges[k] = findLeaves(leaves, Cell<dim, TValue>{neighbors_array[k]});
+}
+
+//! leaves covering the neighbors of each cell of a sorted pack.
+//! \param leaves sorted leaves (a linear tree, not necessarily complete).
+//! \param cells sorted cells.
+//! \param ranges ranges[i][k] are the leaves of the k-th neighbor of cells[i].
+template<typename TStencil, std::size_t dim, typename TValue>
+void neighborLeaves(CellPack<dim, TValue> const& leaves, CellPack<dim, TValue> const& cells,
+                    std::vector<std::array<leaf_range, TStencil::size>>& ranges)
+{
+    static_assert(TStencil::dim == dim, "The stencil dimension is not valid.");
+    using definition = definitions<dim, TValue>;
+    using range_type = tbb::blocked_range<std::size_t>;
+
+    ranges.resize(cells.size());
+    tbb::parallel_for(range_type(0, cells.size(), build_grain), [&](range_type const& r)
+    {
+        std::array<TValue, TStencil::size> neighbors_array;
+        std::array<std::size_t, TStencil::size> hints;
+        hints.fill(r.begin() < cells.size() ? findLeaf(leaves, cells[r.begin()].value) + 1: 0);
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+        {
+            neighbors<TStencil>(cells[i], neighbors_array);
+            for (std::size_t k = 0; k < TStencil::size; ++k)
+            {
+                Cell<dim, TValue> candidate{neighbors_array[k]};
+                if (candidate.value&definition::voidbit)
+                {
+                    ranges[i][k] = leaf_range{};
+                    continue;
+                }
+                hints[k] = gallop_lower_bound(leaves, static_cast<TValue>(candidate.value&definition::maskpos), hints[k]);
+                ranges[i][k] = resolve_candidate(leaves, candidate, hints[k]);
+            }
+        }
+    });
+}
@@ -2,6 +2,9 @@
 #include <vector>
 #include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <type_traits>
 
 #include <tree/node/znode.hpp>
 
@@ -16,24 +19,159 @@ void myreplace_if(ForwardIt first, ForwardIt last,
     }
 }
 
-template < typename TChildren>
+//! sort key of a znode value: the position, then the level.
+template<std::size_t dim, typename zvalue_type>
+inline zvalue_type sortKey(zvalue_type value)
+{
+    using definition = definitions<dim, zvalue_type>;
+    return static_cast<zvalue_type>(((value&definition::maskpos) << definition::nblevelbits)
+                                    | (value >> definition::levelshift));
+}
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Policies for the order of the children of a slot.
+///
+///  - UnsortedChildren (default): the children are in insertion order and
+///    findChild is a linear scan,
+///  - SortedChildren: the children are sorted by sortKey (position, then
+///    level) and findChild is a branchless binary search,
+///  - InterpolatedChildren: same order, findChild guesses the rank by
+///    interpolation (the Morton keys are roughly uniform inside a slot),
+///    brackets the answer by exponential steps around the guess and ends
+///    with the branchless binary search.
+///
+/// In the sorted modes, insertChild keeps the order; after push_back or
+/// insert, call sortChildren to restore it.
+///
+/// \brief order of the children of a slot.
+////////////////////////////////////////////////////////////////////////
+
+struct UnsortedChildren
+{
+    static constexpr bool sorted = false;
+
+    template<typename TIterator, typename TChildren>
+    static inline TIterator find(TIterator first, TIterator last, TChildren const& node)
+    {
+        return std::find_if(first, last, [&](auto const& child){return node.value==child.value;});
+    }
+};
+
+//! find a node in sorted children, knowing the lower bound of its key.
+template<typename TIterator, typename TChildren>
+inline TIterator find_sorted(TIterator it, TIterator last, TChildren const& node)
+{
+    const auto key = sortKey<TChildren::dim>(node.value);
+    for (; it != last && sortKey<TChildren::dim>(it->value) == key; ++it)
+        if (it->value == node.value)
+            return it;
+    return last;
+}
+
+struct SortedChildren
+{
+    static constexpr bool sorted = true;
+
+    //! first child whose key is not less than key (branchless).
+    template<typename TIterator, typename zvalue_type>
+    static inline TIterator lower_bound(TIterator first, TIterator last, zvalue_type key)
+    {
+        constexpr std::size_t dim = std::iterator_traits<TIterator>::value_type::dim;
+        std::size_t n = std::distance(first, last);
+        if (n == 0)
+            return first;
+        while (n > 1)
+        {
+            const std::size_t half = n/2;
+            first = (sortKey<dim>(first[half].value) < key) ? first + half: first;
+            n -= half;
+        }
+        return first + (sortKey<dim>(first->value) < key);
+    }
+
+    template<typename TIterator, typename TChildren>
+    static inline TIterator find(TIterator first, TIterator last, TChildren const& node)
+    {
+        return find_sorted(lower_bound(first, last, sortKey<TChildren::dim>(node.value)), last, node);
+    }
+};
+
+struct InterpolatedChildren
+{
+    static constexpr bool sorted = true;
+    //! under this size, the binary search is used.
+    static constexpr std::size_t min_size = 64;
+
+    //! first child whose key is not less than key.
+    template<typename TIterator, typename zvalue_type>
+    static inline TIterator lower_bound(TIterator first, TIterator last, zvalue_type key)
+    {
+        constexpr std::size_t dim = std::iterator_traits<TIterator>::value_type::dim;
+        const std::size_t n = std::distance(first, last);
+        if (n <= min_size)
+            return SortedChildren::lower_bound(first, last, key);
+
+        const zvalue_type lo = sortKey<dim>(first->value);
+        const zvalue_type hi = sortKey<dim>((last-1)->value);
+        if (key <= lo)
+            return first;
+        if (key > hi)
+            return last;
+
+        // guess the rank, then bracket the answer by exponential steps
+        // around it (the error is O(sqrt(n)) for uniform keys).
+        const std::size_t guess = static_cast<std::size_t>(static_cast<double>(key - lo)/static_cast<double>(hi - lo)*(n - 1));
+        std::size_t step = 8;
+        if (sortKey<dim>(first[guess].value) < key)
+        {
+            std::size_t below = guess + 1;
+            while (below + step < n && sortKey<dim>(first[below + step - 1].value) < key)
+            {
+                below += step;
+                step *= 2;
+            }
+            return SortedChildren::lower_bound(first + below, first + std::min(below + step, n), key);
+        }
+        std::size_t above = guess;
+        while (above > step && !(sortKey<dim>(first[above - step].value) < key))
+        {
+            above -= step;
+            step *= 2;
+        }
+        return SortedChildren::lower_bound(first + (above > step ? above - step: 0), first + above + 1, key);
+    }
+
+    template<typename TIterator, typename TChildren>
+    static inline TIterator find(TIterator first, TIterator last, TChildren const& node)
+    {
+        return find_sorted(lower_bound(first, last, sortKey<TChildren::dim>(node.value)), last, node);
+    }
+};
+
+//! \param TAllocator allocator of the children (see SlotPool for a pool
+//! shared by the slots of a collection).
+template < typename TChildren, typename TPolicy = UnsortedChildren, typename TAllocator = std::allocator<TChildren> >
 class Slot
-    : public ZNode< Slot<TChildren>, TChildren::dim, typename TChildren::zvalue_type >,
-      private std::vector< TChildren >
+    : public ZNode< Slot<TChildren, TPolicy, TAllocator>, TChildren::dim, typename TChildren::zvalue_type >,
+      private std::vector< TChildren, TAllocator >
 {
 public:
-    using znode_type = ZNode< Slot<TChildren>, TChildren::dim, typename TChildren::zvalue_type >;
+    using znode_type = ZNode< Slot<TChildren, TPolicy, TAllocator>, TChildren::dim, typename TChildren::zvalue_type >;
 
     using znode_type::value;
     using znode_type::dim;
     using zvalue_type = typename znode_type::zvalue_type;
     using definition = typename znode_type::definition;
     using children_type = TChildren;
+    using policy_type = TPolicy;
 
-    using container_type = std::vector< TChildren >;
+    using container_type = std::vector< TChildren, TAllocator >;
+    using allocator_type = TAllocator;
 
     using container_type::push_back;
     using container_type::insert;
+    using container_type::erase;
     using container_type::operator[];
     using container_type::begin;
     using container_type::cbegin;
@@ -43,6 +181,8 @@ public:
     using container_type::size;
     using container_type::resize;
     using container_type::capacity;
+    using container_type::data;
+    using container_type::get_allocator;
 
     Slot( zvalue_type s1, std::size_t size=10 )
         : znode_type{s1}
@@ -50,6 +190,12 @@ public:
         reserve(size);
     }
 
+    Slot( zvalue_type s1, std::size_t size, allocator_type const& allocator )
+        : znode_type{s1}, container_type(allocator)
+    {
+        reserve(size);
+    }
+
     template<std::size_t array_size>
     inline void copyChildrenInArray(std::array<children_type, array_size>  array) const
     {
@@ -63,11 +209,25 @@ public:
     //! find a Node.
     //! \param x: Node *hashed*
     //! \note we *do* *not* *check* if x is hashed.
-    inline auto findChild(children_type const & node)
+    //! \note the search depends on the policy (see UnsortedChildren).
+    inline auto findChild(children_type const & node) const
     {
-        auto predicate = [&](auto const& child){return node.value==child.value;};
-        auto index = std::find_if(cbegin(), cend(), predicate);
-        return index;
+        return TPolicy::find(cbegin(), cend(), node);
+    }
+
+    //! add a child: at the end, or at its place if the children are sorted.
+    inline auto insertChild(children_type const & node)
+    {
+        return insert_child(node, std::integral_constant<bool, TPolicy::sorted>{});
+    }
+
+    //! sort the children by sortKey (stable).
+    inline void sortChildren()
+    {
+        std::stable_sort(begin(), end(), [](auto const& a, auto const& b)
+        {
+            return sortKey<dim>(a.value) < sortKey<dim>(b.value);
+        });
     }
 
     /// Remove all the children that have the same tag
@@ -96,6 +256,23 @@ public:
         resize(std::distance(begin(), index));
         this->clearAllTags();
     }
+
+private:
+    inline auto insert_child(children_type const & node, std::false_type)
+    {
+        push_back(node);
+        return end() - 1;
+    }
+
+    inline auto insert_child(children_type const & node, std::true_type)
+    {
+        const zvalue_type key = sortKey<dim>(node.value);
+        auto it = std::upper_bound(begin(), end(), key, [](zvalue_type k, children_type const& child)
+        {
+            return k < sortKey<dim>(child.value);
+        });
+        return insert(it, node);
+    }
 };
 
 
@@ -445,38 +622,6 @@ public:
 //         slotrank = r;
 //     }
 
-//     //! Write slot to a file, already open.
-//     //! _param f the file.
-//     void dump(std::ofstream& f)
-//     {
-//         f << size() << "\n";
-//         f << s2.value << "\n";
-//         f << s1.value << "\n";
-//         f << startrank << "\n";
-//         for_each(cbegin(), cend(), [&](auto &n){f << n.value << "\n";});
-//     }
-
-//     //! restore a slot from a dump.
-//     //! \param file the file to restore from.
-//     void restore(std::ifstream& f)
-//     {
-//         std::size_t ssize;
-//         node_zvalue_type ss1;
-//         node_zvalue_type ss2;
-//         f >> ssize;
-//         f >> ss2;
-//         f >> ss1;
-//         f >> startrank;
-//         s1 = ss1;
-//         s2 = ss2;
-//         for(std::size_t j=0; j<ssize; j++)
-//         {
-//             node_zvalue_type N;
-//             f >> N;
-//             put(node_type{N});
-//         }
-//     }
-
 // };
 
 // template<std::size_t dim, typename node_zvalue_type>
@@ -2,319 +2,593 @@
 
 #include <algorithm>
 #include <array>
-#include <vector>
-#include <memory>
-#include <set>
-#include <iomanip>
+#include <atomic>
+#include <cassert>
+#include <iostream>
 #include <utility>
-#include <tbb/tbb.h>
-#include <tree/slot/slot.hpp>
-#include <tree/slot/cache.hpp>
+#include <vector>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
-template < std::size_t dim, typename node_value_type >
-struct slotCollection : private std::vector< std::shared_ptr< slot<dim, node_value_type> > >
+#include <tree/node/cell.hpp>
+#include <tree/slot/cache.hpp>
+#include <tree/slot/index.hpp>
+#include <tree/slot/pack.hpp>
+#include <tree/slot/slot.hpp>
+#include <tree/slot/sort.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Collection of slots, each one storing the cells whose position is in
+/// an interval [s1, s2[ of the Z curve.
+///
+/// The slots are CellPack stored by value in a PackCollection: the value
+/// of a slot is its lower bound s1 (position only), its upper bound s2
+/// is the value of the next slot (maskpos + 1 for the last one). The
+/// cells of a slot are not sorted. The lower bounds are also stored
+/// contiguously in a SlotIndex (see index.hpp), used to find the slot of
+/// a cell without touching the slots themselves.
+///
+/// The size of the slots is kept in [slot_min_size, slot_max_size]:
+///  - a slot is sorted and cut at its median when it passes slot_max_size,
+///  - a slot is merged with a neighbor when it falls below slot_min_size
+///    (and cut again if the result is too large),
+///  - after a batch insert or a rebalance, the large slots are cut in
+///    pieces of [slot_max_size/2, slot_max_size[ cells in one pass.
+/// With slot_min_size well below slot_max_size/2, a slot cut or merged
+/// needs O(slot_max_size) inserts or removals before the next cut or
+/// merge. A cut or a merge sorts one slot, and shifts the slots after it
+/// in the PackCollection and their bounds in the SlotIndex (whose layout
+/// is rebuilt lazily, see index.hpp): O(slot_max_size) on the cells and
+/// O(number of slots) moves of the slot headers, the cells are not
+/// copied. A single insert or erase costs amortized O(1) on the cells
+/// plus O(number of slots/slot_max_size) header moves. For large
+/// collections, prefer the batch insert, which appends in parallel and
+/// cuts all the large slots in one pass.
+///
+/// Use it like:
+///
+///  slotCollection<3> collection{1, 1024, 256, 1024};
+///  collection.insert(cell);
+///  collection.insert(batch);  // a CellPack of cells, in any order
+///  collection.count(cell);
+///  collection.erase(cell);
+///
+/// The lookups can go through a per-thread Cache of the last slots used
+/// (see cache.hpp): the epoch of the collection changes each time the
+/// slots are cut, merged or moved, which invalidates the caches.
+///
+/// \brief collection of slots with automatic split and merge.
+////////////////////////////////////////////////////////////////////////
+
+//! rank where a pack sorted by position is cut at its median, such that
+//! the cells at the same position stay on the same side.
+//! \return 0 if all the cells are at the same position.
+template<std::size_t dim, typename TValue>
+std::size_t median_cut(CellPack<dim, TValue> const& slot)
 {
-    using slot_type = slot<dim, node_value_type>;
-    using node_type = typename slot_type::node_type;
-    using definition = definitions<dim, node_value_type>;
-
-    using parent = std::vector<std::shared_ptr<slot_type>>;
-    using parent::operator[];
-    using parent::push_back;
-    using parent::insert;
-    using parent::erase;
-    using parent::reserve;
-    using parent::resize;
-    using parent::begin;
-    using parent::end;
-    using parent::cbegin;
-    using parent::cend;
-    using parent::size;
-    using parent::capacity;
-    using parent::shrink_to_fit;
+    using definition = definitions<dim, TValue>;
+    auto position = [&](std::size_t k){return slot[k].value&definition::maskpos;};
+    const std::size_t middle = slot.size()/2;
+    if (middle == 0)
+        return 0;
+    std::size_t cut = middle;
+    while (cut < slot.size() && position(cut) == position(cut-1))
+        ++cut;
+    if (cut < slot.size())
+        return cut;
+    cut = middle;
+    while (cut > 0 && position(cut) == position(cut-1))
+        --cut;
+    return cut;
+}
 
+template < std::size_t dim, typename TValue = std::size_t >
+class slotCollection
+    : private PackCollection<dim, TValue>
+{
+public:
+    using collection_type = PackCollection<dim, TValue>;
+    using slot_type = CellPack<dim, TValue>;
+    using cell_type = Cell<dim, TValue>;
+    using definition = definitions<dim, TValue>;
     using level_count_type = std::array<std::size_t, definition::nlevels+1>;
 
+    using collection_type::operator[];
+    using collection_type::begin;
+    using collection_type::end;
+    using collection_type::cbegin;
+    using collection_type::cend;
+    using collection_type::size;
+    using collection_type::capacity;
+
     std::size_t slot_max_size;  //!< size of slot which triggers decomposition of a slot.
-    std::size_t slot_min_size;    //!< size of slot which triggers fusion of two slots.
+    std::size_t slot_min_size;  //!< size of slot which triggers fusion of two slots.
 
-    //! define order on the Nodes. We use the Peano-Hilbert curve for indexation,
-    //! and thus, we must suppress all what is not position.
-    struct ltNode
+    //! notified when the ranks of the cells are computed (see finalize),
+    //! e.g. to move the data attached to the cells (see CellFields).
+    //! \note the observers stay with the collection object: they are not
+    //! copied nor moved with its cells.
+    struct observer
     {
-        inline bool operator()(const node_type n1,const node_type n2) const
-        {
-            return (n1&node_type::maskpos)<(n2&node_type::maskpos);
-        }
+        virtual ~observer() = default;
+        //! the ranks of the cells have been computed again.
+        virtual void remap(slotCollection const& collection) = 0;
+        //! the collection is destroyed.
+        virtual void detached() = 0;
     };
 
-    using SetNode = std::set<node_type, ltNode>;
-
-    slotCollection() = default;
-    //slotCollection(slotCollection && SC ) = delete; // TODO ?
+    //! one empty slot covering the whole domain.
+    //! \param nslots number of slots to reserve.
+    //! \param slotsize capacity of the first slot.
+    slotCollection(std::size_t nslots,
+                   std::size_t slotsize,
+                   std::size_t _slot_min_size,
+                   std::size_t _slot_max_size)
+        : collection_type{0, nslots},
+          slot_max_size{_slot_max_size},
+          slot_min_size{_slot_min_size}
+    {
+        assert( 2*slot_min_size <= slot_max_size );
+        this->push_back(slot_type{0, slotsize});
+        index.insert(0, 0);
+    }
 
-    slotCollection(std::size_t _nslots,
-                   std::size_t _slotsize,
+    //! collection built from packs of cells (see split).
+    //! \note the packs must be sorted and cover ordered position intervals.
+    slotCollection(collection_type packs,
                    std::size_t _slot_min_size,
-                   std::size_t _slot_max_size):
-        slot_max_size{_slot_max_size},
-        slot_min_size{_slot_min_size}
+                   std::size_t _slot_max_size)
+        : collection_type{std::move(packs)},
+          slot_max_size{_slot_max_size},
+          slot_min_size{_slot_min_size}
     {
-        reserve(_nslots);
-        push_back(std::make_shared<slot_type>(0, definition::AllOnes[definition::nlevels-1], _slotsize));
+        assert( 2*slot_min_size <= slot_max_size );
+        if (size() == 0)
+            this->push_back(slot_type{0, slot_max_size});
+        for (auto& slot : *this)
+            slot.value &= definition::maskpos;
+        (*this)[0].value = 0;
+        rebalance();
     }
 
-    // remark: this copy constructor doesn't set the same capacity of the copied slotCollection
-    slotCollection(slotCollection const& SC):
-        slot_max_size{SC.slot_max_size},
-        slot_min_size{SC.slot_min_size}
+    slotCollection(slotCollection const&) = default;
+    slotCollection(slotCollection&&) = default;
+    slotCollection& operator=(slotCollection const&) = default;
+    slotCollection& operator=(slotCollection&&) = default;
+
+    ~slotCollection()
     {
-        for ( auto const& slot_ptr : SC )
-            push_back( std::make_shared<slot_type>( *slot_ptr ) );
+        for (auto* o : observers.list)
+            o->detached();
     }
 
-    //! An other "copy init". Here we put the Nodes of each slot in a global
-    //! array. This is supposed to reduce the number of allocations. We use
-    //! this to store a local copy of a SlotCollection.
-    //! \param SC slot collection to be copyed.
-    //! \param G global array.
-    void copyInArray(std::vector<node_type>& array)
+    //! notify o at each finalize.
+    inline void attach(observer* o)
     {
-        assert( array.size() == nbNodes() );
-        tbb::parallel_for_each(cbegin(), cend(), [&array](auto &sl){ sl->copyInArray(array.data()+sl->startRank()); });
+        observers.list.push_back(o);
+    }
+
+    inline void detach(observer* o)
+    {
+        observers.list.erase(std::remove(observers.list.begin(), observers.list.end(), o), observers.list.end());
     }
 
-    //! make a "clone", ie copy all, but not the Nodes!
-    // \parameter  C SlotCollection to be "cloned"
-    inline void clone(const slotCollection& C)
+    //! the slots.
+    inline collection_type const& slots() const
     {
-        slot_min_size = C.slot_min_size;
-        slot_max_size = C.slot_max_size;
+        return *this;
+    }
 
-        for ( std::size_t i = 0; i < C.size(); ++i)
-            push_back(std::make_shared<slot_type>(C[i]->s1, C[i]->s2, C[i]->size()*node_type::treetype));
+    //! lower bound of the positions in the slot i.
+    inline TValue s1(std::size_t i) const
+    {
+        return (*this)[i].value;
     }
 
-    /// Is a Node abscissa in the interval [s1,s2[ ?
-    /// \param s1
-    /// \param s2
-    /// \param x Node to check.
-    /// \note x must be *not* hashed.
-    inline bool inInterval(node_type s1, node_type s2, node_type x) const
+    //! upper bound (excluded) of the positions in the slot i.
+    inline TValue s2(std::size_t i) const
     {
-        node_type xabs = x.hash()&node_type::maskpos;
-        return (s1<=xabs) && (s2>xabs);
+        return (i + 1 < size()) ? (*this)[i+1].value: static_cast<TValue>(definition::maskpos + 1);
     }
 
-    /// Store one node using a cache.
-    /// \param x        the node to be inserted.
-    /// \param cache    an external Cache.
-    inline void insert( node_type x, Cache<dim, node_value_type>& cache )
+    //! rank of the slot whose interval contains the position of a cell.
+    inline std::size_t findSlot(cell_type const& cell) const
     {
-        const node_type xh = x.hash(), xabs = xh&node_type::maskpos;
-        auto slot_ptr = cache.find(xabs); // Cache::find returns a shared_ptr.
+        return index.upper_bound(static_cast<TValue>(cell.value&definition::maskpos)) - 1;
+    }
 
-        // std::shared_ptr convertion to bool returns true iff the shared_ptr is valid.
-        if ( ! slot_ptr )
-        {
-            slot_ptr = (*this)[findSlot(xabs, 0, size()-1)];
-            cache.putSlot(slot_ptr); // Updating the cache with the current request.
-        }
+    //! the slot which *possibly* contains a cell.
+    inline slot_type const& ubound(cell_type const& cell) const
+    {
+        return (*this)[findSlot(cell)];
+    }
 
-        slot_ptr->put(xh);
+    //! store one cell.
+    //! \note we do not check if the cell is already stored.
+    inline void insert(cell_type const& cell)
+    {
+        insert_in_slot(findSlot(cell), cell);
     }
 
-    /// Store one node.
-    /// \param x    the node to be inserted.
-    inline void insert( node_type x )
+    //! remove one cell.
+    //! \return the number of removed cells (0 or 1).
+    inline std::size_t erase(cell_type const& cell)
     {
-        const node_type xh = x.hash(), xabs = xh&node_type::maskpos;
-        const auto slot_ptr = (*this)[findSlot(xabs, 0, size()-1)];
-        slot_ptr->put(xh);
+        return erase_in_slot(findSlot(cell), cell);
     }
 
-    //! number of Nodes stored.
-    inline std::size_t nbNodes() const
+    //! number of stored cells equal to cell (0 or 1).
+    inline std::size_t count(cell_type const& cell) const
+    {
+        auto const& slot = (*this)[findSlot(cell)];
+        return slot.findChild(cell) == slot.cend() ? 0 : 1;
+    }
+
+    //! store a batch of cells.
+    //! The batch is sorted, cut along the bounds of the slots in one walk
+    //! and appended to the slots in parallel; the slots which are then
+    //! too large are cut once, at the end.
+    //! \note we do not check if the cells are already stored.
+    void insert(slot_type batch)
     {
-        std::size_t countNodes = 0;
-        for ( auto const& slot_ptr : *this )
-            countNodes += slot_ptr->size();
+        using range_type = tbb::blocked_range<std::size_t>;
+        radixSort(batch);
 
-        return countNodes;
+        std::vector<std::size_t> start(size() + 1, batch.size());
+        std::size_t j = 0;
+        for (std::size_t i = 0; i < size(); ++i)
+        {
+            start[i] = j;
+            const TValue bound = s2(i);
+            while (j < batch.size() && (batch[j].value&definition::maskpos) < bound)
+                ++j;
+        }
+
+        tbb::parallel_for(range_type(0, size()), [&](range_type const& r)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+            {
+                auto& slot = (*this)[i];
+                auto first = batch.cbegin() + start[i], last = batch.cbegin() + start[i+1];
+                if (slot.size() + (last - first) <= slot_max_size)
+                {
+                    slot.insert(slot.end(), first, last);
+                    continue;
+                }
+                // the slot will be cut: only its old cells need a sort.
+                radixSort(slot);
+                slot_type merged{slot.value, slot.size() + (last - first)};
+                merged.resize(slot.size() + (last - first));
+                std::merge(slot.cbegin(), slot.cend(), first, last, merged.begin(),
+                           [](cell_type const& a, cell_type const& b){return sortKey<dim>(a.value) < sortKey<dim>(b.value);});
+                slot = std::move(merged);
+            }
+        });
+
+        if (split_large_slots(true))
+            reindex();
     }
 
-    //! Returns the number of nodes by level.
-    level_count_type nbNodesByLevel() const
+    //! store one cell, looking for its slot in a cache.
+    template<std::size_t cache_size>
+    inline void insert(cell_type const& cell, Cache<dim, TValue, cache_size>& cache)
     {
-        // Initializing level counter.
-        level_count_type countlev;
-        countlev.fill(0);
+        insert_in_slot(cache.find(*this, cell), cell);
+    }
+
+    //! remove one cell, looking for its slot in a cache.
+    template<std::size_t cache_size>
+    inline std::size_t erase(cell_type const& cell, Cache<dim, TValue, cache_size>& cache)
+    {
+        return erase_in_slot(cache.find(*this, cell), cell);
+    }
 
-        // Foreach nodes.
-        for ( auto const& slot_ptr : *this )
-            for ( auto const& node : *slot_ptr )
-                ++countlev[ node.level() ];
+    //! number of stored cells equal to cell (0 or 1), looking for its slot
+    //! in a cache.
+    //! \note the rank of the cell in its slot is stored in the cache.
+    template<std::size_t cache_size>
+    inline std::size_t count(cell_type const& cell, Cache<dim, TValue, cache_size>& cache) const
+    {
+        auto const& slot = (*this)[cache.find(*this, cell)];
+        auto it = slot.findChild(cell);
+        cache.setrankInSlot(std::distance(slot.cbegin(), it));
+        return it == slot.cend() ? 0 : 1;
+    }
 
-        return countlev;
+    //! version of the slots: changes each time the slots are cut, merged
+    //! or moved.
+    //! \note the epochs are unique among the collections of this type.
+    inline std::size_t epoch() const
+    {
+        return slots_epoch;
     }
 
-    //! return a pointer to a slot which *possibly* contains a Node.
-    //! \param x Node *not* *hashed*
-    inline auto ubound(node_type x) const
+    //! sort the slot i and cut it at its median.
+    //! \note the cells at the same position stay in the same slot.
+    void splitSlot(std::size_t i)
     {
-        typename node_type::type maskpos = node_type::maskpos;
-        return (*this)[findSlot(x.hash()&maskpos, 0, size()-1)];
+        auto& slot = (*this)[i];
+        radixSort(slot);
+        const std::size_t cut = median_cut(slot);
+        if (cut == 0)
+            return;
+
+        slot_type upper{static_cast<TValue>(slot[cut].value&definition::maskpos), slot_max_size + 1};
+        upper.insert(upper.end(), slot.cbegin() + cut, slot.cend());
+        slot.resize(cut);
+        index.insert(i + 1, upper.value);
+        collection_type::insert(begin() + i + 1, std::move(upper));
+        slots_epoch = next_epoch();
     }
-    //! return a pointer to a slot which *possibly* contains a Node.
-    //! \param x Node *hashed*
-    inline auto ubound_hashed(node_type x) const
+
+    //! merge the slot i with a neighbor (cut again if too large).
+    void mergeSlot(std::size_t i)
     {
-        typename node_type::type maskpos = node_type::maskpos;
-        return (*this)[findSlot(x&maskpos, 0, size()-1)];
+        assert( size() > 1 );
+        const std::size_t first = (i + 1 < size()) ? i: i - 1;
+        auto& slot = (*this)[first];
+        auto const& next = (*this)[first + 1];
+        slot.reserve(slot_max_size + 1);
+        slot.insert(slot.end(), next.cbegin(), next.cend());
+        collection_type::erase(begin() + first + 1);
+        index.erase(first + 1);
+        slots_epoch = next_epoch();
+        if (slot.size() > slot_max_size)
+            splitSlot(first);
     }
 
-    //! Given a Node, find his slot.
-    //! \param N the Node
-    //! \param left
-    //! \param right
-    //! \note we search in range [left,right] of the SlotCollection
-    //! \note returns the rank of the slot which contains N
-    inline std::size_t findSlot(node_type N, std::size_t left, std::size_t right) const
+    //! merge the small slots and cut the large ones, in one pass.
+    void rebalance()
     {
-        std::size_t middle;
-        while(true)
+        collection_type slots{this->value, size()};
+        for (auto& slot : *this)
         {
-            middle = (left+right)/2;
-            if ( N < (*this)[middle]->s1)
-                right = middle;
-            else if( N >= (*this)[middle]->s2)
-                left = middle + 1;
+            auto* last = (slots.size() > 0) ? &slots[slots.size() - 1]: nullptr;
+            if (last && (last->size() < slot_min_size || slot.size() < slot_min_size))
+                last->insert(last->end(), slot.cbegin(), slot.cend());
             else
-            {
-                left = middle;
-                break;
-            }
+                slots.push_back(std::move(slot));
         }
-        return left;
+        static_cast<collection_type&>(*this) = std::move(slots);
+        split_large_slots();
+        reindex();
     }
 
-    /// Test if a Node exists within this slotCollection, using a cache.
-    /// \param x    Node non hashed.
-    /// \param cach cache updated.
-    /// \returns the number of corresponding found node (either 0 or 1).
-    /// \note we do not directly check if the Node is really non hashed, but
-    ///         this is checked in "xh=hash(x)".
-    inline std::size_t count(node_type x, Cache<dim, node_value_type>& cache) const
+    //! number of cells stored.
+    inline std::size_t nbNodes() const
     {
-        node_type xh = x.hash(), xabs = xh&node_type::maskpos;
-        auto slot_ptr = cache.find(xabs);
+        std::size_t count = 0;
+        for (auto const& slot : *this)
+            count += slot.size();
+        return count;
+    }
 
-        if( ! slot_ptr )
-        {
-            slot_ptr = (*this)[findSlot(xabs, 0, size()-1)];
-            cache.putSlot(slot_ptr);
-        }
+    //! number of cells by level.
+    level_count_type nbNodesByLevel() const
+    {
+        level_count_type countlev;
+        countlev.fill(0);
+        for (auto const& slot : *this)
+            for (auto const& cell : slot)
+                ++countlev[cell.level()];
+        return countlev;
+    }
 
-        const auto node_it = slot_ptr->find(xh);
-        const std::size_t node_pos = ( node_it == slot_ptr->cend() ) ? -1 : std::distance( slot_ptr->cbegin(), node_it );
+    //! maximum size of the slots.
+    inline std::size_t maxSlotSize() const
+    {
+        std::size_t max_slot_size = 0;
+        for (auto const& slot : *this)
+            max_slot_size = std::max(max_slot_size, slot.size());
+        return max_slot_size;
+    }
 
-        cache.setrankInSlot( node_pos );
-        return node_pos != -1 ? 1 : 0;
+    //! compute the rank of the first cell of each slot (see startRank)
+    //! and notify the observers. The index of the slots is brought up to
+    //! date for the lookups which follow.
+    inline void finalize()
+    {
+        index.refresh();
+        start_rank.resize(size() + 1);
+        start_rank[0] = 0;
+        for (std::size_t i = 0; i < size(); ++i)
+            start_rank[i+1] = start_rank[i] + (*this)[i].size();
+        for (auto* o : observers.list)
+            o->remap(*this);
     }
 
-    /// Test if a Node exists within this slotCollection.
-    /// \param x Node non hashed.
-    /// \returns the number of corresponding found node (either 0 or 1).
-    /// \note we do not directly check if the Node is really non hashed, but
-    ///         this is checked in "xh=hash(x)".
-    inline std::size_t count(node_type x) const
+    //! rank of the first cell of the slot i in the whole collection.
+    //! \note valid after finalize().
+    inline std::size_t startRank(std::size_t i) const
     {
-        node_type xh = x.hash(), xabs = xh&node_type::maskpos;
-        const auto slot_ptr     = (*this)[findSlot(xabs, 0, size()-1)];
-        const auto node_it      = slot_ptr->find(xh);
-        return node_it == slot_ptr->cend() ? 0 : 1;
+        return start_rank[i];
     }
 
-    //! remove all free bits from all nodes.
-    inline void forgetFreeBits()
+    //! copy all the cells in an array, slot after slot.
+    void copyInArray(std::vector<cell_type>& array)
     {
-        std::for_each(begin(), end(), [](auto& st){st->forgetFreeBits();});
+        finalize();
+        assert( array.size() == nbNodes() );
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, size()), [&](auto const& r)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+                std::copy((*this)[i].cbegin(), (*this)[i].cend(), array.begin() + start_rank[i]);
+        });
     }
 
-    //! suppress void Nodes, if any.
-    //! update the count of leaves.
-    inline void compress(node_type val=node_type::voidbit)
+    //! remove the cells tagged with tag in the slots tagged with tag
+    //! (see Slot::removeTaggedChildren), then rebalance the slots.
+    inline void compress(TValue tag = definition::voidbit)
     {
-        std::for_each(begin(), end(), [&val](auto& st){st->compress(val);});
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, size()), [&](auto const& r)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+                (*this)[i].removeTaggedChildren(tag);
+        });
+        rebalance();
     }
-    //! empty all the slots.
-    inline void clear()
+
+    //! move the slots out, leaving one empty slot covering the domain.
+    collection_type release()
     {
-        std::for_each(begin(), end(), [](auto& st){st->empty();});
+        collection_type slots{std::move(static_cast<collection_type&>(*this))};
+        static_cast<collection_type&>(*this) = collection_type{0, 1};
+        this->push_back(slot_type{0, slot_max_size});
+        const TValue first = 0;
+        index.assign(&first, &first + 1);
+        slots_epoch = next_epoch();
+        return slots;
     }
 
-    //! make a copy (in a set) of the Nodes.
-    //! \param setN  the set.
-    inline void makeExtern(SetNode& setN)
+    //! empty all the slots (the intervals are kept).
+    inline void clear()
     {
-        for (auto&st: this)
-            for(std::size_t i=0; i<st->size(); ++i)
-                setN.insert(st[i]);
+        for (auto& slot : *this)
+            slot.resize(0);
     }
 
-    //! finalize: compute cumulsize (to allow rank function to work), and maximum
-    //! size of slots;
-    inline void finalize()
+private:
+    //! observers of the object, not of its cells: not copied nor moved.
+    struct observer_list
     {
-        std::size_t wmax=0;
+        std::vector<observer*> list;
 
-        (*this)[0]->setStartRank(0);
-        (*this)[0]->setSlotrank(0);
-        for(std::size_t i=0; i<size(); ++i)
+        observer_list() = default;
+        observer_list(observer_list const&) {}
+        observer_list& operator=(observer_list const&)
         {
-            if (i > 0)
-                (*this)[i]->setStartRank((*this)[i-1]->startRank()+wmax);
-            wmax = (*this)[i]->size();
-            (*this)[i]->setSlotrank(i);
+            return *this;
         }
+    };
+
+    SlotIndex<TValue> index;  //!< lower bounds of the slots.
+    std::vector<std::size_t> start_rank;
+    std::size_t slots_epoch = next_epoch();
+    observer_list observers;
+
+    //! a new epoch (only used when the slots change, not on lookups).
+    static std::size_t next_epoch()
+    {
+        static std::atomic<std::size_t> counter{0};
+        return ++counter;
     }
 
-    //! compute ranks, ...
-    inline void relink()
+    //! index the bounds of the slots after they changed.
+    void reindex()
     {
-        std::size_t wmax=0;
-        (*this)[0]->setStartRank(0);
-        (*this)[0]->setSlotrank(0);
-        for(std::size_t i=0; i<size(); ++i)
+        std::vector<TValue> bounds(size());
+        for (std::size_t i = 0; i < size(); ++i)
+            bounds[i] = (*this)[i].value;
+        index.assign(bounds.cbegin(), bounds.cend());
+        slots_epoch = next_epoch();
+    }
+
+    //! ranks cutting a sorted slot in pieces of [slot_max_size/2,
+    //! slot_max_size[ cells (first 0, last the size), the cells at the
+    //! same position staying in the same piece.
+    std::vector<std::size_t> cut_ranks(slot_type const& slot) const
+    {
+        auto position = [&](std::size_t k){return slot[k].value&definition::maskpos;};
+        const std::size_t n = slot.size();
+        const std::size_t npieces = 2*n/slot_max_size;
+        std::vector<std::size_t> cuts{0};
+        for (std::size_t p = 1; p < npieces; ++p)
         {
-            if(i>0)
-                (*this)[i]->setStartRank((*this)[i-1]->startRank()+wmax);
-            wmax = (*this)[i]->size();
-            (*this)[i]->setSlotrank(i);
+            std::size_t cut = std::max(p*n/npieces, cuts.back() + 1);
+            while (cut < n && position(cut) == position(cut-1))
+                ++cut;
+            if (cut < n)
+                cuts.push_back(cut);
         }
+        cuts.push_back(n);
+        return cuts;
     }
-    //!return maximum size of slots.
-    inline std::size_t maxSlotSize() const
-    {
-        std::size_t max_slot_size = 0;
 
-        for ( const auto & slot_ptr : *this )
-            max_slot_size = std::max( max_slot_size, slot_ptr->size() );
+    //! cut all the slots larger than slot_max_size, in one pass.
+    //! \param sorted the large slots are already sorted.
+    //! \return true if a slot was cut (the index must be rebuilt).
+    bool split_large_slots(bool sorted = false)
+    {
+        using range_type = tbb::blocked_range<std::size_t>;
+        std::vector<std::vector<std::size_t>> cuts(size());
+        tbb::parallel_for(range_type(0, size()), [&](range_type const& r)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+                if ((*this)[i].size() > slot_max_size)
+                {
+                    if (!sorted)
+                        radixSort((*this)[i]);
+                    cuts[i] = cut_ranks((*this)[i]);
+                }
+        });
+
+        std::vector<std::size_t> first(size() + 1, 0);
+        for (std::size_t i = 0; i < size(); ++i)
+            first[i+1] = first[i] + std::max<std::size_t>(cuts[i].size(), 2) - 1;
+        if (first.back() == size())
+            return false;
+
+        std::vector<slot_type> pieces(first.back(), slot_type{0, 0});
+        tbb::parallel_for(range_type(0, size()), [&](range_type const& r)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+            {
+                auto& slot = (*this)[i];
+                if (cuts[i].size() < 3)
+                {
+                    pieces[first[i]] = std::move(slot);
+                    continue;
+                }
+                for (std::size_t p = 0; p + 1 < cuts[i].size(); ++p)
+                {
+                    auto& piece = pieces[first[i] + p];
+                    piece.value = (p == 0) ? slot.value: static_cast<TValue>(slot[cuts[i][p]].value&definition::maskpos);
+                    piece.reserve(slot_max_size + 1);
+                    piece.insert(piece.end(), slot.cbegin() + cuts[i][p], slot.cbegin() + cuts[i][p+1]);
+                }
+            }
+        });
 
-        return max_slot_size;
+        collection_type slots{this->value, pieces.size()};
+        for (auto& piece : pieces)
+            slots.push_back(std::move(piece));
+        static_cast<collection_type&>(*this) = std::move(slots);
+        return true;
     }
 
+    inline void insert_in_slot(std::size_t i, cell_type const& cell)
+    {
+        (*this)[i].push_back(cell);
+        if ((*this)[i].size() > slot_max_size)
+            splitSlot(i);
+    }
 
+    inline std::size_t erase_in_slot(std::size_t i, cell_type const& cell)
+    {
+        auto& slot = (*this)[i];
+        auto it = slot.findChild(cell);
+        if (it == slot.cend())
+            return 0;
+
+        slot[std::distance(slot.cbegin(), it)] = slot[slot.size() - 1];
+        slot.resize(slot.size() - 1);
+        if (slot.size() < slot_min_size && size() > 1)
+            mergeSlot(i);
+        return 1;
+    }
 };
 
-template<std::size_t dim, typename node_value_type>
-std::ostream& operator<<(std::ostream& os, const slotCollection<dim, node_value_type>& st)
+template<std::size_t dim, typename TValue>
+std::ostream& operator<<(std::ostream& os, const slotCollection<dim, TValue>& collection)
 {
-    using definition = typename slotCollection<dim, node_value_type>::definition;
-
-    os << "slotCollection" << std::endl;;
-    os << definition::AllOnes[definition::nlevels-1] << std::endl;
-    for_each(st.begin(), st.end(), [](auto &sl){std::cout << *sl.get() << std::endl;});
+    os << "slotCollection\n";
+    for (std::size_t i = 0; i < collection.size(); ++i)
+    {
+        os << "slot " << i << " size: " << collection[i].size() << " s1: ";
+        collection[i].print_value(os);
+        os << "\n";
+    }
     return os;
 }
@@ -0,0 +1,223 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+#include <tree/node/definitions.hpp>
+#include <tree/slot/slot.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Parallel LSD radix sort of the children of a slot.
+///
+/// The children are sorted by position and then by level (the ancestors
+/// first); the free bits (tags, voidbit) are ignored. The digits which
+/// are the same for all the children (e.g. the level in a single-level
+/// pack) are detected with an or/and reduction and skipped.
+///
+/// A payload (e.g. some field data attached to the cells) can be
+/// reordered in the same passes.
+///
+/// Use it like:
+///
+///  radixSort(pack);
+///  radixSort(pack, payload);
+///
+/// \brief radix sort of CellPack and PackCollection.
+////////////////////////////////////////////////////////////////////////
+
+//! number of bits sorted by each pass.
+constexpr std::size_t radix_bits = 11;
+constexpr std::size_t radix_size = std::size_t{1} << radix_bits;
+//! number of elements handled by one task.
+constexpr std::size_t radix_grain = std::size_t{1} << 14;
+//! under this size, an insertion sort is used.
+constexpr std::size_t radix_min_size = 64;
+
+//! data moved along with the keys, using a temporary buffer.
+template<typename T>
+struct radix_buffer
+{
+    T* data;
+    std::vector<T> tmp;
+
+    radix_buffer(T* d, std::size_t size)
+        : data{d}, tmp(size)
+    {}
+
+    //! move the element from of the input to the position to of the output.
+    //! \param odd the input is the temporary buffer.
+    inline void move(std::size_t from, std::size_t to, bool odd)
+    {
+        if (odd)
+            data[to] = std::move(tmp[from]);
+        else
+            tmp[to] = std::move(data[from]);
+    }
+
+    inline void swap(std::size_t i, std::size_t j)
+    {
+        std::swap(data[i], data[j]);
+    }
+
+    //! copy back the result if it is in the temporary buffer.
+    inline void finish(bool odd)
+    {
+        if (odd)
+            tbb::parallel_for(tbb::blocked_range<std::size_t>(0, tmp.size(), radix_grain),
+                              [&](auto const& r)
+                              {
+                                  std::move(tmp.begin() + r.begin(), tmp.begin() + r.end(), data + r.begin());
+                              });
+    }
+};
+
+//! no payload.
+struct radix_no_buffer
+{
+    inline void move(std::size_t, std::size_t, bool) {}
+    inline void swap(std::size_t, std::size_t) {}
+    inline void finish(bool) {}
+};
+
+//! LSD radix sort of keys.
+//! \param scatter scatter(from, to, odd) moves the data attached to the key.
+//! \return true if the sorted keys are in keys_tmp.
+template<typename zvalue_type, typename TScatter>
+bool radix_sort_impl(zvalue_type* keys, zvalue_type* keys_tmp, std::size_t size, TScatter&& scatter)
+{
+    using range_type = tbb::blocked_range<std::size_t>;
+    using bits_type = std::pair<zvalue_type, zvalue_type>;
+
+    // the digits which are the same for all the keys are not sorted.
+    const bits_type bits = tbb::parallel_reduce(range_type(0, size, radix_grain),
+        bits_type{0, static_cast<zvalue_type>(~zvalue_type{0})},
+        [&](range_type const& r, bits_type acc)
+        {
+            for (std::size_t i = r.begin(); i < r.end(); ++i)
+            {
+                acc.first |= keys[i];
+                acc.second &= keys[i];
+            }
+            return acc;
+        },
+        [](bits_type const& a, bits_type const& b)
+        {
+            return bits_type{a.first|b.first, a.second&b.second};
+        });
+    const zvalue_type diff = bits.first ^ bits.second;
+
+    const std::size_t nblocks = (size + radix_grain - 1)/radix_grain;
+    std::vector<std::size_t> offsets(nblocks*radix_size);
+    bool odd = false;
+    for (std::size_t shift = 0; shift < sizeof(zvalue_type)*8; shift += radix_bits)
+    {
+        if (((diff >> shift)&(radix_size-1)) == 0)
+            continue;
+
+        zvalue_type const* in = odd ? keys_tmp: keys;
+        zvalue_type* out = odd ? keys: keys_tmp;
+        auto digit = [&](std::size_t i){return static_cast<std::size_t>(in[i] >> shift)&(radix_size-1);};
+
+        // histogram of each block
+        tbb::parallel_for(range_type(0, nblocks, 1), [&](range_type const& r)
+        {
+            for (std::size_t b = r.begin(); b < r.end(); ++b)
+            {
+                std::size_t* count = offsets.data() + b*radix_size;
+                std::fill(count, count + radix_size, 0);
+                for (std::size_t i = b*radix_grain; i < std::min(size, (b+1)*radix_grain); ++i)
+                    ++count[digit(i)];
+            }
+        });
+
+        // exclusive scan (digit major, block minor to keep the sort stable)
+        std::size_t sum = 0;
+        for (std::size_t d = 0; d < radix_size; ++d)
+            for (std::size_t b = 0; b < nblocks; ++b)
+            {
+                const std::size_t count = offsets[b*radix_size + d];
+                offsets[b*radix_size + d] = sum;
+                sum += count;
+            }
+
+        tbb::parallel_for(range_type(0, nblocks, 1), [&](range_type const& r)
+        {
+            for (std::size_t b = r.begin(); b < r.end(); ++b)
+            {
+                std::size_t* offset = offsets.data() + b*radix_size;
+                for (std::size_t i = b*radix_grain; i < std::min(size, (b+1)*radix_grain); ++i)
+                {
+                    const std::size_t to = offset[digit(i)]++;
+                    out[to] = in[i];
+                    scatter(i, to, odd);
+                }
+            }
+        });
+        odd = !odd;
+    }
+    return odd;
+}
+
+template<typename TChildren, typename TPolicy, typename TAllocator, typename TPayload>
+void radix_sort_slot(Slot<TChildren, TPolicy, TAllocator>& slot, TPayload& payload)
+{
+    using zvalue_type = typename TChildren::zvalue_type;
+    const std::size_t size = slot.size();
+
+    std::vector<zvalue_type> keys(size);
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, size, radix_grain), [&](auto const& r)
+    {
+        for (std::size_t i = r.begin(); i < r.end(); ++i)
+            keys[i] = sortKey<TChildren::dim>(slot[i].value);
+    });
+
+    if (size <= radix_min_size)
+    {
+        for (std::size_t i = 1; i < size; ++i)
+            for (std::size_t j = i; j > 0 && keys[j] < keys[j-1]; --j)
+            {
+                std::swap(keys[j], keys[j-1]);
+                std::swap(slot[j], slot[j-1]);
+                payload.swap(j, j-1);
+            }
+        return;
+    }
+
+    std::vector<zvalue_type> keys_tmp(size);
+    radix_buffer<TChildren> children{slot.data(), size};
+    const bool odd = radix_sort_impl(keys.data(), keys_tmp.data(), size,
+                                     [&](std::size_t from, std::size_t to, bool o)
+                                     {
+                                         children.move(from, to, o);
+                                         payload.move(from, to, o);
+                                     });
+    children.finish(odd);
+    payload.finish(odd);
+}
+
+//! sort the children of a slot by position, then by level.
+//! \note the free bits are ignored and the sort is stable.
+template<typename TChildren, typename TPolicy, typename TAllocator>
+void radixSort(Slot<TChildren, TPolicy, TAllocator>& slot)
+{
+    radix_no_buffer payload;
+    radix_sort_slot(slot, payload);
+}
+
+//! sort the children of a slot by position, then by level, and reorder
+//! the payload in the same way.
+//! \param payload data attached to the children (same size as slot).
+//! \note to get the permutation, use the indices 0..size-1 as payload.
+template<typename TChildren, typename TPolicy, typename TAllocator, typename TPayload>
+void radixSort(Slot<TChildren, TPolicy, TAllocator>& slot, std::vector<TPayload>& payload)
+{
+    assert( payload.size() == slot.size() );
+    radix_buffer<TPayload> buffer{payload.data(), payload.size()};
+    radix_sort_slot(slot, buffer);
+}
@@ -0,0 +1,95 @@
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <tree/node/cell.hpp>
+#include <tree/slot/hashpack.hpp>
+#include <tree/slot/slot.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Compare the searches of Slot::findChild and HashPack::count.
+///
+/// A pack of random cells of the finest level (uniform Morton keys) is
+/// searched for cells of the pack (hits) and random cells (mostly
+/// misses), with:
+///  - UnsortedChildren: linear scan,
+///  - SortedChildren: branchless binary search,
+///  - InterpolatedChildren: interpolation then binary search,
+///  - HashPack: open-addressing hash table.
+///
+/// Usage: bench_findchild [number of queries]
+///
+/// \brief linear, binary, interpolation and hashed search in a slot.
+////////////////////////////////////////////////////////////////////////
+
+constexpr std::size_t dim = 3;
+using value_type = std::size_t;
+using cell_type = Cell<dim, value_type>;
+using definition = definitions<dim, value_type>;
+
+template<typename TPolicy>
+double run(std::vector<cell_type> const& cells, std::vector<cell_type> const& queries, std::size_t& found)
+{
+    Slot<cell_type, TPolicy> slot{0, cells.size()};
+    for (auto const& cell : cells)
+        slot.insertChild(cell);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto const& query : queries)
+        found += (slot.findChild(query) != slot.cend());
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count()*1e9/queries.size();
+}
+
+double run_hashed(std::vector<cell_type> const& cells, std::vector<cell_type> const& queries, std::size_t& found)
+{
+    HashPack<cell_type> pack{0, cells.size()};
+    for (auto const& cell : cells)
+        pack.insert(cell);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto const& query : queries)
+        found += pack.count(query);
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count()*1e9/queries.size();
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t nqueries = (argc > 1) ? std::atoi(argv[1]): 1000000;
+    const std::size_t level = definition::nlevels - 1;
+    std::mt19937_64 gen(1);
+    auto random_cell = [&]
+    {
+        cell_type::coords_type coords;
+        for (auto& c : coords)
+            c = gen()%(value_type{2} << level);
+        return cell_type{cell_type::encode(coords, level)};
+    };
+
+    std::cout << "size\tlinear (ns)\tbinary (ns)\tinterpolation (ns)\thash (ns)\n";
+    for (std::size_t size = 8; size <= (std::size_t{1} << 16); size *= 2)
+    {
+        std::vector<cell_type> cells(size);
+        for (auto& cell : cells)
+            cell = random_cell();
+
+        // fewer queries for the linear scan of large packs
+        std::vector<cell_type> queries(std::max<std::size_t>(nqueries*8/size, 1000));
+        for (std::size_t i = 0; i < queries.size(); ++i)
+            queries[i] = (i%2) ? cells[gen()%size]: random_cell();
+
+        std::size_t found = 0;
+        const double linear = run<UnsortedChildren>(cells, queries, found);
+        queries.resize(nqueries);
+        for (std::size_t i = 0; i < queries.size(); ++i)
+            queries[i] = (i%2) ? cells[gen()%size]: random_cell();
+        const double binary = run<SortedChildren>(cells, queries, found);
+        const double interpolation = run<InterpolatedChildren>(cells, queries, found);
+        const double hashed = run_hashed(cells, queries, found);
+        std::cout << size << "\t" << linear << "\t" << binary << "\t" << interpolation << "\t" << hashed << "\t(" << found << ")\n";
+    }
+    return 0;
+}
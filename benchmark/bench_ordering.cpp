@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <tree/node/cell.hpp>
+#include <tree/node/neighbor.hpp>
+#include <tree/node/ordering.hpp>
+#include <tree/node/stencil.hpp>
+
+/////////////////////////////////////////////////////////////////////////
+///
+/// Compare the locality of the Z and Hilbert orders.
+///
+/// The cells of a uniform 3d grid are sorted along the curve and cut in
+/// slots of fixed size. For each cell, the 26 neighbors are looked up in
+/// the sorted keys and we count:
+///  - the lookups landing in an other slot than the cell,
+///  - the misses of a small LRU cache of slots (proxy of the cache misses
+///    when the slots are the unit of memory locality).
+///
+/// Usage: bench_ordering [level] [slot size] [cache size]
+///
+/// \brief neighbor lookups in Z and Hilbert orders.
+////////////////////////////////////////////////////////////////////////
+
+constexpr std::size_t dim = 3;
+using value_type = std::size_t;
+using cell_type = Cell<dim, value_type>;
+using definition = definitions<dim, value_type>;
+using stencil_type = CornerStencil<dim>;
+
+struct result
+{
+    std::size_t lookups = 0;
+    std::size_t cross_slot = 0;
+    std::size_t cache_misses = 0;
+    double time = 0;
+};
+
+template<typename TOrder>
+result run(std::size_t level, std::size_t slot_size, std::size_t cache_size)
+{
+    const std::size_t n = std::size_t{2} << level;
+    std::vector<value_type> keys;
+    keys.reserve(n*n*n);
+    for (std::size_t i = 0; i < n*n*n; ++i)
+    {
+        typename cell_type::coords_type coords{{i%n, (i/n)%n, i/(n*n)}};
+        keys.push_back(TOrder::template key<dim>(cell_type::encode(coords, level)));
+    }
+    std::sort(keys.begin(), keys.end());
+
+    result res;
+    std::vector<std::size_t> cache;
+    std::array<value_type, stencil_type::size> neighbors_array;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::size_t rank = 0; rank < keys.size(); ++rank)
+    {
+        cell_type cell{TOrder::template value<dim>(keys[rank])};
+        neighbors<stencil_type>(cell, neighbors_array);
+        for (auto neighbor : neighbors_array)
+        {
+            if (neighbor&definition::voidbit)
+                continue;
+            const value_type key = TOrder::template key<dim>(neighbor);
+            const std::size_t slot = std::distance(keys.cbegin(), std::lower_bound(keys.cbegin(), keys.cend(), key))/slot_size;
+            ++res.lookups;
+            if (slot != rank/slot_size)
+                ++res.cross_slot;
+
+            auto it = std::find(cache.begin(), cache.end(), slot);
+            if (it == cache.end())
+            {
+                ++res.cache_misses;
+                if (cache.size() == cache_size)
+                    cache.pop_back();
+            }
+            else
+                cache.erase(it);
+            cache.insert(cache.begin(), slot);
+        }
+    }
+    res.time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return res;
+}
+
+void print(char const* name, result const& res)
+{
+    std::cout << name
+              << "\tlookups: " << res.lookups
+              << "\tcross slot: " << 100.*res.cross_slot/res.lookups << "%"
+              << "\tcache misses: " << 100.*res.cache_misses/res.lookups << "%"
+              << "\ttime: " << res.time << "s\n";
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t level = (argc > 1) ? std::atoi(argv[1]): 5;
+    const std::size_t slot_size = (argc > 2) ? std::atoi(argv[2]): 1000;
+    const std::size_t cache_size = (argc > 3) ? std::atoi(argv[3]): 4;
+
+    std::cout << "level: " << level << "\tslot size: " << slot_size << "\tcache size: " << cache_size << "\n";
+    print("Z", run<ZOrder>(level, slot_size, cache_size));
+    print("Hilbert", run<HilbertOrder>(level, slot_size, cache_size));
+    return 0;
+}
@@ -1,6 +1,19 @@
 #include "gtest/gtest.h"
 #include <tuple>
+#include <numeric>
+#include <random>
+#include <vector>
 #include <tree/slot/pack.hpp>
+#include <tree/slot/sort.hpp>
+#include <tree/slot/build.hpp>
+#include <tree/slot/balance.hpp>
+#include <tree/slot/adapt.hpp>
+#include <tree/slot/search.hpp>
+#include <tree/slot/hashpack.hpp>
+#include <tree/slot/pool.hpp>
+#include <tree/slot/compressed.hpp>
+#include <tree/slot/prefix.hpp>
+#include <tree/slot/siblings.hpp>
 
 #define DIM_GROUP(T) std::tuple<std::integral_constant<std::size_t, 1>, T>, std::tuple<std::integral_constant<std::size_t, 2>, T>, std::tuple<std::integral_constant<std::size_t, 3>, T>
 
@@ -12,9 +25,20 @@ struct SlotTest: public ::testing::Test {
     using cellpack_type = CellPack<dim, zvalue_type>;
     using cell_type = typename cellpack_type::children_type;
     using definition = typename cellpack_type::definition;
+
+    //! random value covering all the digits of zvalue_type.
+    template <typename TGen>
+    static zvalue_type random_value(TGen & gen)
+    {
+        constexpr std::size_t shift = (sizeof(zvalue_type) > 8) ? 64 : 0;
+        zvalue_type v = 0;
+        for ( std::size_t i = 0; i < sizeof(zvalue_type); i += 8 )
+            v = static_cast<zvalue_type>((v << shift) | gen());
+        return v;
+    }
 };
 
-typedef ::testing::Types<DIM_GROUP(unsigned short), DIM_GROUP(unsigned int), DIM_GROUP(std::size_t)> SlotTypes;
+typedef ::testing::Types<DIM_GROUP(unsigned short), DIM_GROUP(unsigned int), DIM_GROUP(std::size_t), DIM_GROUP(unsigned __int128)> SlotTypes;
 TYPED_TEST_CASE(SlotTest, SlotTypes);
 
 TYPED_TEST(SlotTest, constructor)
@@ -119,6 +143,864 @@ TYPED_TEST(SlotTest, removeTaggedChildren_all)
         EXPECT_EQ( slot[i].value, 2*i );
 }
 
+TYPED_TEST(SlotTest, sortedFindChild)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using cellpack_type = typename TestFixture::cellpack_type;
+
+    auto check = [&](auto& sorted, std::size_t n)
+    {
+        std::mt19937_64 gen(23);
+        cellpack_type linear{0, n};
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const std::size_t level = gen()%definition::nlevels;
+            cell_type cell{static_cast<zvalue_type>((TestFixture::random_value(gen)&definition::AllOnes[level])
+                                                    + (static_cast<zvalue_type>(level) << definition::levelshift))};
+            if (linear.findChild(cell) == linear.cend())
+            {
+                linear.push_back(cell);
+                sorted.insertChild(cell);
+            }
+            // an ancestor at the same position
+            cell_type ancestor{static_cast<zvalue_type>((cell.value&definition::AllOnes[0]) + (gen()%2)*definition::firstfreebit)};
+            if (level > 0 && linear.findChild(ancestor) == linear.cend())
+            {
+                linear.push_back(ancestor);
+                sorted.insertChild(ancestor);
+            }
+        }
+
+        ASSERT_EQ( sorted.size(), linear.size() );
+        for (std::size_t i = 1; i < sorted.size(); ++i)
+            EXPECT_LE( sortKey<dim>(sorted[i-1].value), sortKey<dim>(sorted[i].value) );
+        for (auto const& cell : linear)
+        {
+            auto it = sorted.findChild(cell);
+            ASSERT_NE( it, sorted.cend() );
+            EXPECT_EQ( it->value, cell.value );
+        }
+        for (std::size_t i = 0; i < 100; ++i)
+        {
+            cell_type cell{static_cast<zvalue_type>(TestFixture::random_value(gen)&(definition::maskpos|definition::levelzone))};
+            EXPECT_EQ( sorted.findChild(cell) == sorted.cend(), linear.findChild(cell) == linear.cend() );
+        }
+    };
+
+    for (std::size_t n : {0, 1, 10, 100, 1000})
+    {
+        SortedCellPack<dim, zvalue_type> sorted{0, n};
+        check(sorted, n);
+        Slot<cell_type, InterpolatedChildren> interpolated{0, n};
+        check(interpolated, n);
+    }
+
+    // sortChildren restores the order
+    std::mt19937_64 gen(5);
+    SortedCellPack<dim, zvalue_type> pack{0, 100};
+    for (std::size_t i = 0; i < 100; ++i)
+        pack.push_back(cell_type{static_cast<zvalue_type>(TestFixture::random_value(gen)&definition::maskpos)});
+    pack.sortChildren();
+    for (std::size_t i = 1; i < pack.size(); ++i)
+        EXPECT_LE( sortKey<dim>(pack[i-1].value), sortKey<dim>(pack[i].value) );
+    for (auto const& cell : pack)
+        EXPECT_EQ( pack.findChild(cell)->value, cell.value );
+}
+
+TYPED_TEST(SlotTest, hashPack)
+{
+    constexpr auto dim = TestFixture::dim;
+    constexpr auto voidbit = TestFixture::definition::voidbit;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using cellpack_type = typename TestFixture::cellpack_type;
+
+    std::mt19937_64 gen(31);
+    HashCellPack<dim, zvalue_type> hashed{0};
+    cellpack_type linear{0, 1000};
+    auto stored = [&](cell_type const& cell)
+    {
+        return std::any_of(linear.cbegin(), linear.cend(), [&](auto const& c)
+        {
+            return ((c.value^cell.value)&definition::partWithoutFreeBits) == 0;
+        });
+    };
+    for (std::size_t i = 0; i < 1000; ++i)
+    {
+        const std::size_t level = gen()%definition::nlevels;
+        cell_type cell{static_cast<zvalue_type>((TestFixture::random_value(gen)&definition::AllOnes[level])
+                                                + (static_cast<zvalue_type>(level) << definition::levelshift))};
+        if (gen()%3 == 0)
+            cell.setTags(voidbit);
+        const bool inserted = hashed.insert(cell).second;
+        EXPECT_EQ( inserted, !stored(cell) );
+        if (inserted)
+            linear.push_back(cell);
+    }
+
+    // the table grows and keeps all the nodes, found whatever their tags
+    ASSERT_EQ( hashed.size(), linear.size() );
+    EXPECT_LE( 8*hashed.size(), 7*hashed.capacity() );
+    EXPECT_EQ( static_cast<std::size_t>(std::distance(hashed.cbegin(), hashed.cend())), hashed.size() );
+    for (auto const& cell : linear)
+    {
+        ASSERT_EQ( hashed.count(cell), 1 );
+        EXPECT_EQ( hashed.findChild(cell)->value, cell.value );
+        cell_type untagged{cell.value};
+        untagged.clearAllTags();
+        EXPECT_EQ( hashed.count(untagged), 1 );
+    }
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        cell_type cell{static_cast<zvalue_type>(TestFixture::random_value(gen)&(definition::maskpos|definition::levelzone))};
+        EXPECT_EQ( hashed.count(cell), static_cast<std::size_t>(stored(cell)) );
+    }
+
+    // erase half of the nodes, then insert them back
+    for (std::size_t i = 0; i < linear.size(); i += 2)
+        EXPECT_EQ( hashed.erase(linear[i]), 1 );
+    EXPECT_EQ( hashed.erase(linear[0]), 0 );
+    EXPECT_EQ( hashed.size(), linear.size()/2 );
+    for (std::size_t i = 0; i < linear.size(); ++i)
+        EXPECT_EQ( hashed.count(linear[i]), i%2 );
+    for (std::size_t i = 0; i < linear.size(); i += 2)
+        EXPECT_TRUE( hashed.insert(linear[i]).second );
+    EXPECT_EQ( hashed.size(), linear.size() );
+
+    // same tags as Slot::removeTaggedChildren
+    const std::size_t ntagged = std::count_if(linear.cbegin(), linear.cend(), [&](auto const& c){return c.hasTags(voidbit);});
+    auto copy = hashed;
+    hashed.removeTaggedChildren(voidbit);
+    EXPECT_EQ( hashed.size(), linear.size() );
+    hashed.setTags(voidbit);
+    hashed.removeTaggedChildren(voidbit);
+    EXPECT_EQ( hashed.size(), linear.size() - ntagged );
+    copy.removeTaggedChildren();
+    EXPECT_EQ( copy.size(), linear.size() - ntagged );
+    for (auto const& cell : linear)
+    {
+        EXPECT_EQ( hashed.count(cell), !cell.hasTags(voidbit) );
+        EXPECT_EQ( copy.count(cell), !cell.hasTags(voidbit) );
+    }
+    for (auto const& cell : hashed)
+        EXPECT_FALSE( cell.hasTags(voidbit) );
+
+    hashed.clear();
+    EXPECT_EQ( hashed.size(), 0 );
+    EXPECT_EQ( hashed.cbegin(), hashed.cend() );
+    EXPECT_EQ( hashed.count(linear[1]), 0 );
+}
+
+TYPED_TEST(SlotTest, pool)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using cell_type = typename TestFixture::cell_type;
+    using pack_type = PooledCellPack<dim, zvalue_type>;
+
+    SlotPool pool{std::size_t{1} << 14};
+    PoolAllocator<cell_type> allocator{pool};
+    Slot<pack_type> packs{0, 64};
+    auto fill = [&]
+    {
+        for (std::size_t i = 0; i < 64; ++i)
+        {
+            packs.push_back(pack_type{static_cast<zvalue_type>(i), 1, allocator});
+            for (std::size_t k = 0; k < 10*i; ++k)
+                packs[i].push_back(cell_type{static_cast<zvalue_type>(k)});
+        }
+    };
+    auto check = [&](std::size_t step)
+    {
+        for (std::size_t i = 0; i < packs.size(); ++i)
+        {
+            EXPECT_EQ( packs[i].get_allocator(), allocator );
+            ASSERT_EQ( packs[i].size(), 10*step*i );
+            for (std::size_t k = 0; k < packs[i].size(); ++k)
+                EXPECT_EQ( packs[i][k].value, k );
+        }
+    };
+
+    fill();
+    check(1);
+    EXPECT_GT( pool.nbChunks(), 0 );
+
+    // the freed blocks are used again: no new chunk
+    const std::size_t nchunks = pool.nbChunks();
+    for (std::size_t cycle = 0; cycle < 3; ++cycle)
+    {
+        packs.erase(packs.begin(), packs.end());
+        fill();
+        check(1);
+        EXPECT_EQ( pool.nbChunks(), nchunks );
+    }
+
+    // the used blocks are moved in new chunks
+    packs.erase(packs.begin() + 16, packs.end());
+    pool.compact(packs);
+    EXPECT_LT( pool.nbChunks(), nchunks );
+    check(1);
+
+    radixSort(packs[15]);
+    EXPECT_EQ( packs[15][0].value, 0 );
+
+    pool.clear(packs);
+    EXPECT_EQ( packs.size(), 0 );
+    EXPECT_EQ( pool.nbChunks(), 0 );
+    fill();
+    check(1);
+}
+
+TYPED_TEST(SlotTest, compressedPack)
+{
+    constexpr auto dim = TestFixture::dim;
+    constexpr auto voidbit = TestFixture::definition::voidbit;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using cellpack_type = typename TestFixture::cellpack_type;
+
+    // random cells of all levels, with duplicates and tags, not sorted
+    std::mt19937_64 gen(41);
+    cellpack_type pack{7, 1000};
+    for (std::size_t i = 0; i < 1000; ++i)
+    {
+        const std::size_t level = gen()%definition::nlevels;
+        cell_type cell{static_cast<zvalue_type>((TestFixture::random_value(gen)&definition::AllOnes[level])
+                                                + (static_cast<zvalue_type>(level) << definition::levelshift))};
+        if (gen()%5 == 0)
+            cell.setTags(voidbit);
+        pack.push_back(cell);
+        if (gen()%10 == 0)
+            pack.push_back(cell);
+    }
+
+    CompressedPack<dim, zvalue_type> compressed{pack};
+    EXPECT_EQ( compressed.value, 7 );
+    ASSERT_EQ( compressed.size(), pack.size() );
+    EXPECT_EQ( compressed.nbBlocks(), (pack.size() + 127)/128 );
+
+    cellpack_type sorted{pack};
+    radixSort(sorted);
+    auto decompressed = compressed.decompress();
+    ASSERT_EQ( decompressed.size(), sorted.size() );
+    std::size_t k = 0;
+    for (auto it = compressed.cbegin(); it != compressed.cend(); ++it, ++k)
+    {
+        EXPECT_EQ( (*it).value, sorted[k].value );
+        EXPECT_EQ( decompressed[k].value, sorted[k].value );
+        EXPECT_EQ( it.index(), k );
+    }
+    EXPECT_EQ( k, sorted.size() );
+    for (std::size_t i = 0; i < sorted.size(); i += 37)
+        EXPECT_EQ( compressed[i].value, sorted[i].value );
+
+    for (auto const& cell : pack)
+    {
+        auto it = compressed.findChild(cell);
+        ASSERT_NE( it, compressed.cend() );
+        EXPECT_EQ( (*it).value, cell.value );
+        EXPECT_EQ( compressed.count(cell), std::count_if(pack.cbegin(), pack.cend(), [&](auto const& c){return c.value == cell.value;}) );
+    }
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        cell_type cell{static_cast<zvalue_type>(TestFixture::random_value(gen)&(definition::maskpos|definition::levelzone))};
+        EXPECT_EQ( compressed.findChild(cell) == compressed.cend(), pack.findChild(cell) == pack.cend() );
+    }
+
+    // a complete level takes (almost) only the block headers
+    const std::size_t level = std::min<std::size_t>(definition::nlevels - 1, 12/dim);
+    cellpack_type complete{0, std::size_t{1} << (dim*(level + 1))};
+    for (std::size_t i = 0; i < (std::size_t{1} << (dim*(level + 1))); ++i)
+        complete.push_back(cell_type{static_cast<zvalue_type>((static_cast<zvalue_type>(i) << (dim*(definition::nlevels - 1 - level)))
+                                                              + (static_cast<zvalue_type>(level) << definition::levelshift))});
+    CompressedPack<dim, zvalue_type> compressed_complete{complete};
+    EXPECT_LT( 4*compressed_complete.memory(), complete.size()*sizeof(cell_type) );
+    k = 0;
+    for (auto const& cell : compressed_complete)
+        EXPECT_EQ( cell.value, complete[k++].value );
+
+    CompressedPack<dim, zvalue_type> empty{cellpack_type{0, 0}};
+    EXPECT_EQ( empty.size(), 0 );
+    EXPECT_EQ( empty.cbegin(), empty.cend() );
+    EXPECT_EQ( empty.findChild(cell_type{0}), empty.cend() );
+}
+
+TYPED_TEST(SlotTest, prefixPack)
+{
+    constexpr auto dim = TestFixture::dim;
+    constexpr auto voidbit = TestFixture::definition::voidbit;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using cellpack_type = typename TestFixture::cellpack_type;
+
+    std::mt19937_64 gen(43);
+    auto check = [&](auto suffix, std::size_t level)
+    {
+        using prefixpack_type = PrefixPack<dim, zvalue_type, decltype(suffix)>;
+        const std::size_t shift = prefixpack_type::level_shift(level);
+        const zvalue_type levelbits = static_cast<zvalue_type>(static_cast<zvalue_type>(level) << definition::levelshift);
+        const zvalue_type upper = static_cast<zvalue_type>(prefixpack_type::prefix_mask(level)&definition::maskpos);
+        const zvalue_type lower = static_cast<zvalue_type>(definition::AllOnes[level]&~upper);
+        const zvalue_type high = static_cast<zvalue_type>(TestFixture::random_value(gen)&upper);
+
+        // cells of the level sharing their upper position bits
+        cellpack_type pack{0, 200};
+        for (std::size_t i = 0; i < 200; ++i)
+        {
+            cell_type cell{static_cast<zvalue_type>(high | (TestFixture::random_value(gen)&lower) | levelbits)};
+            if (gen()%5 == 0)
+                cell.setTags(voidbit);
+            pack.push_back(cell);
+        }
+        ASSERT_TRUE( prefixpack_type::factorable(pack) );
+
+        prefixpack_type prefixed{pack};
+        EXPECT_EQ( prefixed.prefix(), high | levelbits );
+        ASSERT_EQ( prefixed.size(), pack.size() );
+        std::size_t k = 0;
+        for (auto const& cell : prefixed)
+            EXPECT_EQ( cell.value, pack[k++].value );
+        EXPECT_EQ( prefixed.cend() - prefixed.cbegin(), pack.size() );
+        EXPECT_EQ( prefixed.cbegin()[5].value, pack[5].value );
+        EXPECT_EQ( prefixed.expand().size(), pack.size() );
+
+        for (auto const& cell : pack)
+        {
+            auto it = prefixed.findChild(cell);
+            ASSERT_NE( it, prefixed.cend() );
+            EXPECT_EQ( (*it).value, cell.value );
+            EXPECT_EQ( prefixed.count(cell), std::count_if(pack.cbegin(), pack.cend(), [&](auto const& c){return c.value == cell.value;}) );
+        }
+
+        // the brothers of a cell fit
+        std::array<zvalue_type, definition::treetype> family;
+        brothers(cell_type{firstSon(cell_type{father(pack[0])})}, family);
+        for (auto const& brother : family)
+            EXPECT_TRUE( prefixed.fits(cell_type{brother}) );
+
+        // another level or another prefix does not fit
+        cell_type coarse{static_cast<zvalue_type>(high | (static_cast<zvalue_type>(level == 0 ? 1: level - 1) << definition::levelshift))};
+        EXPECT_FALSE( prefixed.fits(coarse) );
+        EXPECT_EQ( prefixed.findChild(coarse), prefixed.cend() );
+        if (upper != 0 && high != upper)
+        {
+            const zvalue_type next = static_cast<zvalue_type>(high + (static_cast<zvalue_type>(prefixpack_type::suffix_mask + 1) << shift));
+            cell_type other{static_cast<zvalue_type>(next | levelbits)};
+            EXPECT_FALSE( prefixed.fits(other) );
+            pack.push_back(other);
+            EXPECT_FALSE( prefixpack_type::factorable(pack) );
+            pack.resize(pack.size() - 1);
+        }
+
+        prefixed.sortChildren();
+        cellpack_type sorted{pack};
+        sorted.sortChildren();
+        k = 0;
+        for (auto const& cell : prefixed)
+            EXPECT_EQ( cell.value, sorted[k++].value );
+
+        prefixed.setTags(voidbit);
+        prefixed.removeTaggedChildren(voidbit);
+        pack.removeTaggedChildren();
+        EXPECT_EQ( prefixed.size(), pack.size() );
+        for (auto const& cell : prefixed)
+            EXPECT_FALSE( cell.value&definition::FreeBitsPart );
+    };
+    // the finest level, a coarse one, and a level covered by a suffix
+    for (std::size_t level : {std::size_t(definition::nlevels - 1), std::size_t(definition::nlevels/2), std::size_t{1}})
+    {
+        check(std::uint16_t{}, level);
+        check(std::uint32_t{}, level);
+    }
+
+    using prefixpack_type = PrefixPack<dim, zvalue_type, std::uint32_t>;
+    prefixpack_type empty{cellpack_type{0, 0}};
+    EXPECT_TRUE( empty.empty() );
+    EXPECT_EQ( empty.cbegin(), empty.cend() );
+}
+
+TYPED_TEST(SlotTest, siblingPack)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using cellpack_type = typename TestFixture::cellpack_type;
+    using siblingpack_type = SiblingPack<dim, zvalue_type>;
+
+    auto make_cell = [](zvalue_type pos, std::size_t level)
+    {
+        return cell_type{static_cast<zvalue_type>((pos&definition::AllOnes[level]) + (static_cast<zvalue_type>(level) << definition::levelshift))};
+    };
+    auto sorted_values = [](auto const& cells)
+    {
+        std::vector<zvalue_type> values;
+        for (auto const& cell : cells)
+            values.push_back(cell.value);
+        std::sort(values.begin(), values.end());
+        return values;
+    };
+
+    // a complete level, and random cells of all levels (with duplicates)
+    std::mt19937_64 gen(47);
+    const std::size_t level = std::min<std::size_t>(definition::nlevels - 1, 9/dim);
+    const std::size_t ncomplete = std::size_t{1} << (dim*(level + 1));
+    cellpack_type pack{0, ncomplete + 300};
+    for (std::size_t i = 0; i < ncomplete; ++i)
+        pack.push_back(make_cell(static_cast<zvalue_type>(static_cast<zvalue_type>(i) << (dim*(definition::nlevels - 1 - level))), level));
+    for (std::size_t i = 0; i < 300; ++i)
+        pack.push_back(make_cell(TestFixture::random_value(gen), gen()%definition::nlevels));
+
+    siblingpack_type siblings{pack};
+    auto unique = sorted_values(pack);
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    EXPECT_EQ( siblings.size(), unique.size() );
+    EXPECT_EQ( sorted_values(siblings), unique );
+    EXPECT_EQ( sorted_values(siblings.expand()), unique );
+    EXPECT_LE( siblings.nbFamilies(), ncomplete/definition::treetype + 300 );
+    for (auto const& cell : pack)
+        EXPECT_EQ( siblings.count(cell), 1 );
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        cell_type cell = make_cell(TestFixture::random_value(gen), gen()%definition::nlevels);
+        EXPECT_EQ( siblings.count(cell), std::binary_search(unique.cbegin(), unique.cend(), cell.value) ? 1: 0 );
+    }
+
+    // a complete level takes a value by brotherhood
+    siblingpack_type complete{cellpack_type{pack.value, ncomplete}};
+    for (std::size_t i = 0; i < ncomplete; ++i)
+        EXPECT_TRUE( complete.insert(pack[i]) );
+    EXPECT_FALSE( complete.insert(pack[0]) );
+    EXPECT_EQ( complete.size(), ncomplete );
+    EXPECT_EQ( complete.nbFamilies(), ncomplete/definition::treetype );
+    EXPECT_EQ( complete.brothersMask(pack[0]), siblingpack_type::full_mask );
+    EXPECT_LT( complete.memory(), ncomplete*sizeof(cell_type) );
+
+    // refine and coarsen
+    if (level + 1 < definition::nlevels)
+    {
+        cell_type cell = pack[ncomplete/2];
+        EXPECT_TRUE( complete.refine(cell) );
+        EXPECT_EQ( complete.count(cell), 0 );
+        EXPECT_EQ( complete.count(cell_type{firstSon(cell)}), 1 );
+        EXPECT_EQ( complete.size(), ncomplete - 1 + definition::treetype );
+        EXPECT_FALSE( complete.refine(cell) );
+        EXPECT_TRUE( complete.coarsen(cell) );
+        EXPECT_FALSE( complete.coarsen(cell) );
+        EXPECT_EQ( complete.count(cell), 1 );
+        EXPECT_EQ( complete.size(), ncomplete );
+    }
+    EXPECT_EQ( complete.coarsenComplete(), ncomplete/definition::treetype );
+    EXPECT_EQ( complete.size(), ncomplete/definition::treetype );
+    EXPECT_EQ( complete.count(make_cell(0, level - 1)), 1 );
+
+    EXPECT_TRUE( complete.erase(make_cell(0, level - 1)) );
+    EXPECT_FALSE( complete.erase(make_cell(0, level - 1)) );
+    EXPECT_EQ( complete.size(), ncomplete/definition::treetype - 1 );
+
+    siblingpack_type empty;
+    EXPECT_TRUE( empty.empty() );
+    EXPECT_EQ( empty.cbegin(), empty.cend() );
+}
+
+TYPED_TEST(SlotTest, radixSort)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using cellpack_type = typename TestFixture::cellpack_type;
+
+    std::mt19937_64 gen(7);
+    auto random_cell = [&](std::size_t level)
+    {
+        zvalue_type v = static_cast<zvalue_type>(gen());
+        if (sizeof(zvalue_type) > 8)
+            v = static_cast<zvalue_type>((v << (sizeof(zvalue_type) > 8 ? 64 : 0)) | gen());
+        v = static_cast<zvalue_type>((v&definition::AllOnes[level]) + (static_cast<zvalue_type>(level) << definition::levelshift));
+        if (gen()%3 == 0)
+            v |= static_cast<zvalue_type>(gen()%32) * definition::firstfreebit;
+        return cell_type{v};
+    };
+    auto less = [](cell_type const& a, cell_type const& b)
+    {
+        return sortKey<dim>(a.value) < sortKey<dim>(b.value);
+    };
+
+    for (std::size_t size : {0, 1, 10, 100, 50000})
+        for (bool single_level : {false, true})
+        {
+            const std::size_t level = definition::nlevels - 1;
+            std::vector<cell_type> cells(size);
+            for (auto& c : cells)
+                c = random_cell(single_level ? level : gen()%definition::nlevels);
+
+            cellpack_type slot{0, size};
+            slot.insert(slot.begin(), cells.cbegin(), cells.cend());
+            std::vector<std::size_t> permutation(size);
+            std::iota(permutation.begin(), permutation.end(), 0);
+            radixSort(slot, permutation);
+
+            // the payload follows the children
+            for (std::size_t i = 0; i < size; ++i)
+                EXPECT_EQ( slot[i].value, cells[permutation[i]].value );
+
+            std::stable_sort(cells.begin(), cells.end(), less);
+            EXPECT_EQ( slot.size(), size );
+            for (std::size_t i = 0; i < size; ++i)
+                EXPECT_EQ( slot[i].value, cells[i].value );
+        }
+}
+
+TYPED_TEST(SlotTest, buildFromPoints)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using coords_type = typename cell_type::coords_type;
+
+    // uniform points and a cluster in a corner
+    std::mt19937_64 gen(11);
+    const std::size_t n = std::size_t{1} << std::min(definition::nlevels, 10);
+    std::vector<coords_type> points(20000);
+    for (std::size_t i = 0; i < points.size(); ++i)
+        for (std::size_t d = 0; d < dim; ++d)
+            points[i][d] = static_cast<zvalue_type>(gen()%((i&1) ? n : std::max<std::size_t>(n/16, 1)));
+
+    const std::size_t max_points = 10;
+    auto const leaves = buildLeaves(points, max_points);
+
+    std::vector<std::size_t> start;
+    auto const cells = encodePoints(points, start);
+    EXPECT_EQ( start.back(), points.size() );
+
+    auto size = [](cell_type const& c)
+    {
+        return static_cast<zvalue_type>(zvalue_type{1} << (dim*(definition::nlevels-1-c.level())));
+    };
+    auto count = [&](cell_type const& c)
+    {
+        auto compare = [](cell_type const& a, zvalue_type p){return (a.value&definition::maskpos) < p;};
+        const zvalue_type pos = c.value&definition::maskpos;
+        const std::size_t first = std::lower_bound(cells.cbegin(), cells.cend(), pos, compare) - cells.cbegin();
+        const std::size_t last = std::lower_bound(cells.cbegin(), cells.cend(), static_cast<zvalue_type>(pos + size(c)), compare) - cells.cbegin();
+        return start[last] - start[first];
+    };
+
+    // the leaves are a complete linear tree ...
+    zvalue_type next = 0;
+    std::size_t npoints = 0;
+    for (auto const& leaf : leaves)
+    {
+        EXPECT_EQ( leaf.value&definition::maskpos, next );
+        next = static_cast<zvalue_type>(next + size(leaf));
+
+        // ... with at most max_points points, and which cannot be coarsened
+        const std::size_t c = count(leaf);
+        npoints += c;
+        if (leaf.level() < definition::nlevels-1)
+        {
+            EXPECT_LE( c, max_points );
+        }
+        if (leaf.level() > 0)
+        {
+            EXPECT_GT( count(cell_type{father(leaf)}), max_points );
+        }
+    }
+    EXPECT_EQ( next, static_cast<zvalue_type>(definition::maskpos + 1) );
+    EXPECT_EQ( npoints, points.size() );
+
+    // the same leaves in packs
+    const std::size_t pack_size = 100;
+    auto const collection = buildFromPoints(points, max_points, pack_size);
+    EXPECT_EQ( collection.size(), (leaves.size() + pack_size - 1)/pack_size );
+    for (auto const& pack : collection)
+    {
+        EXPECT_LE( pack.size(), pack_size );
+        EXPECT_EQ( pack.value, pack[0].value );
+    }
+    auto const flat = flatten(collection);
+    ASSERT_EQ( flat.size(), leaves.size() );
+    for (std::size_t i = 0; i < leaves.size(); ++i)
+        EXPECT_EQ( flat[i].value, leaves[i].value );
+}
+
+//! brute force 2:1 balance check: two leaves are adjacent if they touch
+//! in at most n directions and overlap in the others.
+template<std::size_t n, typename TPack>
+bool bruteForceBalanced(TPack const& leaves)
+{
+    using definition = typename TPack::definition;
+    constexpr std::size_t dim = TPack::dim;
+
+    for (auto const& a : leaves)
+        for (auto const& b : leaves)
+        {
+            if (a.level() <= b.level() + 1)
+                continue;
+            const std::size_t sa = definition::nlevels-1-a.level(), sb = definition::nlevels-1-b.level();
+            auto const ca = a.coordinates(), cb = b.coordinates();
+            std::size_t touch = 0;
+            bool adjacent = true;
+            for (std::size_t d = 0; d < dim; ++d)
+            {
+                const auto a0 = ca[d] << sa, a1 = (ca[d] + 1) << sa;
+                const auto b0 = cb[d] << sb, b1 = (cb[d] + 1) << sb;
+                if (a1 == b0 || b1 == a0)
+                    ++touch;
+                else if (a1 < b0 || b1 < a0)
+                    adjacent = false;
+            }
+            if (adjacent && touch >= 1 && touch <= n)
+                return false;
+        }
+    return true;
+}
+
+TYPED_TEST(SlotTest, balance)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using coords_type = typename cell_type::coords_type;
+
+    // a few points in a corner give a strongly unbalanced tree
+    std::mt19937_64 gen(13);
+    const std::size_t n = std::size_t{1} << std::min(definition::nlevels, 8);
+    std::vector<coords_type> points(40);
+    for (auto& p : points)
+        for (std::size_t d = 0; d < dim; ++d)
+            p[d] = static_cast<zvalue_type>(gen()%std::max<std::size_t>(n/64, 2));
+    auto const leaves = buildLeaves(points, 1);
+    if (definition::nlevels > 4)
+    {
+        EXPECT_FALSE( isBalanced<FaceStencil<dim>>(leaves) );
+    }
+
+    auto check = [&](auto const& balanced, auto const& brute_force)
+    {
+        // the balanced tree is complete and only refines the leaves
+        zvalue_type next = 0;
+        for (auto const& leaf : balanced)
+        {
+            EXPECT_EQ( leaf.value&definition::maskpos, next );
+            next = static_cast<zvalue_type>(next + (zvalue_type{1} << (dim*(definition::nlevels-1-leaf.level()))));
+            EXPECT_TRUE( isAncestor(leaves[findLeaf(leaves, leaf.value)], leaf) );
+        }
+        EXPECT_EQ( next, static_cast<zvalue_type>(definition::maskpos + 1) );
+        if (balanced.size() < 3000)
+        {
+            EXPECT_TRUE( brute_force(balanced) );
+        }
+    };
+
+    auto face = balance<FaceStencil<dim>>(leaves);
+    check(face, [](auto const& l){return bruteForceBalanced<1>(l);});
+    EXPECT_TRUE( isBalanced<FaceStencil<dim>>(face) );
+    EXPECT_EQ( isBalanced<FaceStencil<dim>>(leaves), bruteForceBalanced<1>(leaves) );
+
+    auto corner = balance<CornerStencil<dim>>(leaves);
+    check(corner, [](auto const& l){return bruteForceBalanced<dim>(l);});
+    EXPECT_TRUE( isBalanced<CornerStencil<dim>>(corner) );
+    EXPECT_EQ( isBalanced<CornerStencil<dim>>(leaves), bruteForceBalanced<dim>(leaves) );
+    EXPECT_GE( corner.size(), face.size() );
+
+    auto edge = balance<FaceEdgeStencil<dim>>(leaves);
+    check(edge, [](auto const& l){return bruteForceBalanced<2>(l);});
+    EXPECT_TRUE( isBalanced<FaceEdgeStencil<dim>>(edge) );
+
+    // a balanced tree is not changed
+    auto again = balance<CornerStencil<dim>>(corner);
+    ASSERT_EQ( again.size(), corner.size() );
+    for (std::size_t i = 0; i < corner.size(); ++i)
+        EXPECT_EQ( again[i].value, corner[i].value );
+
+    // collection version
+    auto collection = balance<FaceStencil<dim>>(split(leaves, 64), 64);
+    EXPECT_TRUE( isBalanced<FaceStencil<dim>>(collection) );
+    EXPECT_EQ( flatten(collection).size(), face.size() );
+}
+
+TYPED_TEST(SlotTest, adapt)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using coords_type = typename cell_type::coords_type;
+    using tags = adapt_tags<dim, zvalue_type>;
+
+    std::mt19937_64 gen(29);
+    const std::size_t n = std::size_t{1} << std::min(definition::nlevels, 8);
+    std::vector<coords_type> points(200);
+    for (auto& p : points)
+        for (std::size_t d = 0; d < dim; ++d)
+            p[d] = static_cast<zvalue_type>(gen()%n);
+    auto leaves = buildLeaves(points, 2);
+
+    auto is_complete = [&](auto const& cells)
+    {
+        zvalue_type next = 0;
+        for (auto const& cell : cells)
+        {
+            if ((cell.value&definition::maskpos) != next || (cell.value&tags::all))
+                return false;
+            next = static_cast<zvalue_type>(next + (zvalue_type{1} << (dim*(definition::nlevels-1-cell.level()))));
+        }
+        return next == static_cast<zvalue_type>(definition::maskpos + 1);
+    };
+
+    // refine some leaves
+    std::vector<std::size_t> refined;
+    for (std::size_t i = 0; i < leaves.size(); ++i)
+        if (gen()%3 == 0 && leaves[i].level() + 1 < definition::nlevels)
+        {
+            leaves[i].setTags(tags::refine);
+            refined.push_back(i);
+        }
+    auto fine = adapt(leaves);
+    EXPECT_TRUE( is_complete(fine) );
+    EXPECT_EQ( fine.size(), leaves.size() + refined.size()*(definition::treetype - 1) );
+    for (auto i : refined)
+        EXPECT_TRUE( isAncestor(leaves[i], fine[findLeaf(fine, leaves[i].value)]) );
+
+    // coarsen the new children: back to the original leaves
+    for (auto& cell : fine)
+        if (leaves[findLeaf(leaves, cell.value)].level() != cell.level())
+            cell.setTags(tags::coarsen);
+    auto coarse = adapt(fine);
+    ASSERT_EQ( coarse.size(), leaves.size() );
+    for (std::size_t i = 0; i < leaves.size(); ++i)
+        EXPECT_EQ( coarse[i].value, static_cast<zvalue_type>(leaves[i].value&definition::partWithoutFreeBits) );
+
+    // an incomplete or partially tagged group is not coarsened
+    for (auto& cell : fine)
+        cell.setTags(tags::coarsen);
+    std::size_t kept = 0;
+    while (kept < fine.size() && (fine[kept].level() == 0 || fine[kept].isMinimal()))
+        ++kept;
+    ASSERT_LT( kept, fine.size() );
+    fine[kept].unsetTags(tags::coarsen);
+    auto all = adapt(fine);
+    EXPECT_TRUE( is_complete(all) );
+    EXPECT_LT( all.size(), fine.size() );
+    EXPECT_EQ( all[findLeaf(all, fine[kept].value)].value, static_cast<zvalue_type>(fine[kept].value&definition::partWithoutFreeBits) );
+
+    // collection version
+    for (auto& cell : leaves)
+        cell.setTags(tags::refine);
+    auto collection = adapt(split(leaves, 64), 64);
+    EXPECT_TRUE( is_complete(flatten(collection)) );
+}
+
+TYPED_TEST(SlotTest, neighborLeaves)
+{
+    constexpr auto dim = TestFixture::dim;
+    using zvalue_type = typename TestFixture::zvalue_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = typename TestFixture::cell_type;
+    using coords_type = typename cell_type::coords_type;
+    using stencil_type = CornerStencil<dim>;
+
+    // an unbalanced tree with a hole
+    std::mt19937_64 gen(37);
+    const std::size_t n = std::size_t{1} << std::min(definition::nlevels, 8);
+    std::vector<coords_type> points(60);
+    for (auto& p : points)
+        for (std::size_t d = 0; d < dim; ++d)
+            p[d] = static_cast<zvalue_type>((gen()%4 == 0) ? gen()%n: gen()%std::max<std::size_t>(n/16, 2));
+    auto const complete_leaves = buildLeaves(points, 1);
+    using cellpack_type = typename TestFixture::cellpack_type;
+
+    // brute force: the leaves overlapping the candidate
+    auto check = [&](cellpack_type const& leaves, zvalue_type value, leaf_range const& range)
+    {
+        cell_type candidate{value};
+        std::vector<std::size_t> expected;
+        if (!(value&definition::voidbit))
+            for (std::size_t i = 0; i < leaves.size(); ++i)
+                if (isAncestor(candidate, leaves[i]) || isAncestor(leaves[i], candidate))
+                    expected.push_back(i);
+
+        ASSERT_EQ( range.last - range.first, expected.size() );
+        for (std::size_t i = 0; i < expected.size(); ++i)
+            EXPECT_EQ( range.first + i, expected[i] );
+        if (expected.empty())
+        {
+            EXPECT_EQ( range.kind, neighbor_kind::none );
+        }
+        else if (leaves[expected[0]].level() == candidate.level())
+        {
+            EXPECT_EQ( range.kind, neighbor_kind::same );
+        }
+        else if (leaves[expected[0]].level() < candidate.level())
+        {
+            EXPECT_EQ( range.kind, neighbor_kind::coarser );
+        }
+        else
+        {
+            EXPECT_EQ( range.kind, neighbor_kind::finer );
+        }
+    };
+
+    auto check_all = [&](cellpack_type const& leaves)
+    {
+        std::vector<std::array<leaf_range, stencil_type::size>> batch;
+        neighborLeaves<stencil_type>(leaves, leaves, batch);
+        ASSERT_EQ( batch.size(), leaves.size() );
+
+        std::array<zvalue_type, stencil_type::size> neighbors_array;
+        std::array<leaf_range, stencil_type::size> ranges;
+        for (std::size_t i = 0; i < leaves.size(); ++i)
+        {
+            neighbors<stencil_type>(leaves[i], neighbors_array);
+            neighborLeaves<stencil_type>(leaves, leaves[i], ranges);
+            for (std::size_t k = 0; k < stencil_type::size; ++k)
+            {
+                check(leaves, neighbors_array[k], ranges[k]);
+                EXPECT_EQ( batch[i][k].first, ranges[k].first );
+                EXPECT_EQ( batch[i][k].last, ranges[k].last );
+                EXPECT_EQ( batch[i][k].kind, ranges[k].kind );
+            }
+        }
+    };
+
+    // a leaf removed in the middle
+    check_all(compact(complete_leaves, [&](std::size_t i){return i != complete_leaves.size()/2;}));
+
+    // the first son of a brotherhood removed
+    std::size_t first_son = 0;
+    while (first_son < complete_leaves.size()
+           && (complete_leaves[first_son].level() == 0 || !complete_leaves[first_son].isMinimal()))
+        ++first_son;
+    ASSERT_LT( first_son, complete_leaves.size() );
+    check_all(compact(complete_leaves, [&](std::size_t i){return i != first_son;}));
+
+    // only the non corner sons cover a cell
+    cell_type root{0};
+    cellpack_type sons{0, definition::treetype};
+    std::array<zvalue_type, definition::treetype> brothers_array;
+    brothers(cell_type{firstSon(root)}, brothers_array);
+    for (std::size_t i = 0; i < definition::treetype; ++i)
+        if (brothers_array[i] != firstSon(root))
+            sons.push_back(cell_type{brothers_array[i]});
+    sons.sortChildren();
+    check(sons, root.value, findLeaves(sons, root));
+    auto const range = findLeaves(sons, root);
+    EXPECT_EQ( range.kind, neighbor_kind::finer );
+    EXPECT_EQ( range.first, 0 );
+    EXPECT_EQ( range.last, definition::treetype - 1 );
+    check_all(sons);
+}
+
 // TYPED_TEST(SlotTest, markedOther)
 // {
 //     auto const dim = TestFixture::dim;
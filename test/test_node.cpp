@@ -1,8 +1,14 @@
 #include "gtest/gtest.h"
 #include <tuple>
+#include <random>
+#include <vector>
 #include <tree/node/definitions.hpp>
 #include <tree/node/cell.hpp>
 #include <tree/node/family.hpp>
+#include <tree/node/batch.hpp>
+#include <tree/node/stencil.hpp>
+#include <tree/node/ordering.hpp>
+#include <tree/node/refine.hpp>
 #include <tree/node/util.hpp>
 #include <tree/slot/slot.hpp>
 
@@ -50,6 +56,17 @@ struct CellTest: public ::testing::Test {
         std::for_each(brothers.begin(), brothers.end(), [&level](auto &b){b >>= level*dim;});
         return brothers;
     }
+
+    //! random value covering all the digits of value_type.
+    template <typename TGen>
+    static value_type random_value(TGen & gen)
+    {
+        constexpr std::size_t shift = (sizeof(value_type) > 8) ? 64 : 0;
+        value_type v = 0;
+        for ( std::size_t i = 0; i < sizeof(value_type); i += 8 )
+            v = static_cast<value_type>((v << shift) | gen());
+        return v;
+    }
 };
 
 typedef ::testing::Types<DIM_GROUP(unsigned short, test_cell),
@@ -57,7 +74,9 @@ typedef ::testing::Types<DIM_GROUP(unsigned short, test_cell),
                          DIM_GROUP(std::size_t   , test_cell),
                          DIM_GROUP(unsigned short, test_slot),
                          DIM_GROUP(unsigned int  , test_slot),
-                         DIM_GROUP(std::size_t   , test_slot)> CellTypes;
+                         DIM_GROUP(std::size_t   , test_slot),
+                         DIM_GROUP(unsigned __int128, test_cell),
+                         DIM_GROUP(unsigned __int128, test_slot)> CellTypes;
 TYPED_TEST_CASE(CellTest, CellTypes);
 
 TYPED_TEST(CellTest, constructor)
@@ -134,6 +153,29 @@ TYPED_TEST(CellTest, hash)
     EXPECT_EQ( cell_unhash.isHashed(), false );
 }
 
+TYPED_TEST(CellTest, lastlevel)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using definition = typename TestFixture::definition;
+    using node_type = typename TestFixture::node_type;
+
+    std::mt19937_64 gen(17);
+    for ( std::size_t i = 0; i < 100; ++i )
+    {
+        const std::size_t level = gen()%definition::nlevels;
+        const value_type mask = (level > 0) ? definition::AllOnes[level-1]: value_type{0};
+        const value_type father = static_cast<value_type>((TestFixture::random_value(gen)&mask)
+                                                          + (static_cast<value_type>(level) << definition::levelshift));
+        for ( std::size_t c = 0; c < definition::treetype; ++c )
+        {
+            node_type cell{static_cast<value_type>(father + (static_cast<value_type>(c) << dim*(definition::nlevels-1-level)))};
+            EXPECT_EQ( cell.lastlevel(), c );
+            EXPECT_EQ( cell.isMinimal(), c == 0 );
+        }
+    }
+}
+
 TYPED_TEST(CellTest, brothers)
 {
     constexpr auto dim = TestFixture::dim;
@@ -185,4 +227,230 @@ TYPED_TEST(CellTest, star)
     node_type cell{0};
     starNeighbors<stencil>(cell, b);
     // TODO: add the test
-}
\ No newline at end of file
+}
+TYPED_TEST(CellTest, encode)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using definition = typename TestFixture::definition;
+    using node_type = typename TestFixture::node_type;
+    using coords_type = typename node_type::coords_type;
+
+    for ( std::size_t level = 0; level < definition::nlevels; ++level)
+    {
+        const value_type nmax = static_cast<value_type>((value_type{2} << level) - 1);
+        for ( value_type c : {value_type{0}, value_type{1}, static_cast<value_type>(nmax/3), nmax} )
+        {
+            coords_type coords;
+            value_type expected = static_cast<value_type>(level) << definition::levelshift;
+            for ( std::size_t d = 0; d < dim; ++d )
+            {
+                coords[d] = static_cast<value_type>((c + d) & nmax);
+                // bit by bit construction
+                for ( std::size_t b = 0; b <= level; ++b )
+                    if ( (coords[d] >> b) & 1 )
+                        expected |= (definition::Xbit >> d) >> (dim*(level-b));
+            }
+
+            node_type cell{node_type::encode(coords, level)};
+            EXPECT_EQ( cell.value, expected );
+            EXPECT_EQ( cell.level(), level );
+            EXPECT_EQ( cell.coordinates(), coords );
+            EXPECT_EQ( node_type{cell.hash()}.coordinates(), coords );
+        }
+    }
+}
+
+TYPED_TEST(CellTest, encode_batch)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using definition = typename TestFixture::definition;
+    using node_type = typename TestFixture::node_type;
+    using coords_type = typename node_type::coords_type;
+
+    const std::size_t level = definition::nlevels - 1;
+    const std::size_t n = (level < 6) ? (std::size_t{2} << level) : 100;
+    std::vector<coords_type> coords(n), decoded(n);
+    for ( std::size_t i = 0; i < n; ++i )
+        for ( std::size_t d = 0; d < dim; ++d )
+            coords[i][d] = static_cast<value_type>((i*(d+1)) % n);
+
+    std::vector<value_type> values(n);
+    node_type::encode(coords.data(), n, level, values.data());
+    node_type::decode(values.data(), n, decoded.data());
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+        EXPECT_EQ( values[i], node_type::encode(coords[i], level) );
+        EXPECT_EQ( decoded[i], coords[i] );
+    }
+}
+
+TYPED_TEST(CellTest, batch)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = Cell<dim, value_type>;
+
+    // random cells with void and tagged ones
+    std::mt19937_64 gen(42);
+    const std::size_t n = 101;
+    std::vector<value_type> input(n), output(n);
+    for ( auto& v : input )
+    {
+        const std::size_t level = gen()%(definition::nlevels - 1) + 1;
+        v = static_cast<value_type>((TestFixture::random_value(gen)&definition::AllOnes[level]) + (static_cast<value_type>(level) << definition::levelshift));
+        if ( gen()%5 == 0 )
+            v |= definition::voidbit;
+        if ( gen()%7 == 0 )
+            v |= definition::firstfreebit;
+    }
+
+    for ( std::size_t d = 0; d < dim; ++d )
+        for ( std::size_t stencil = 0; stencil < 3; ++stencil )
+        {
+            plus<dim>(input.data(), output.data(), n, static_cast<direction>(d), stencil);
+            for ( std::size_t i = 0; i < n; ++i )
+                EXPECT_EQ( output[i], cell_type{input[i]}.plus(static_cast<direction>(d), stencil) );
+            minus<dim>(input.data(), output.data(), n, static_cast<direction>(d), stencil);
+            for ( std::size_t i = 0; i < n; ++i )
+                EXPECT_EQ( output[i], cell_type{input[i]}.minus(static_cast<direction>(d), stencil) );
+        }
+
+    std::vector<std::size_t> levels(n);
+    level<dim>(input.data(), levels.data(), n);
+    for ( std::size_t i = 0; i < n; ++i )
+        EXPECT_EQ( levels[i], cell_type{input[i]}.level() );
+
+    hash<dim>(input.data(), output.data(), n);
+    for ( std::size_t i = 0; i < n; ++i )
+        EXPECT_EQ( output[i], cell_type{input[i]}.hash() );
+    unhash<dim>(output.data(), output.data(), n);
+    EXPECT_EQ( output, input );
+
+    father<dim>(input.data(), output.data(), n);
+    for ( std::size_t i = 0; i < n; ++i )
+        EXPECT_EQ( output[i], father(cell_type{input[i]}) );
+}
+
+TYPED_TEST(CellTest, plus_offset)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = Cell<dim, value_type>;
+    using node_type = typename TestFixture::node_type;
+
+    std::mt19937_64 gen(17);
+    for ( std::size_t i = 0; i < 500; ++i )
+    {
+        const std::size_t level = gen()%definition::nlevels;
+        const int range = (level < 2) ? (2 << level) : 8;
+        node_type node{static_cast<value_type>((TestFixture::random_value(gen)&definition::AllOnes[level]) + (static_cast<value_type>(level) << definition::levelshift))};
+        if ( gen()%5 == 0 )
+            node.value |= definition::voidbit;
+
+        // chained version
+        std::array<int, dim> offset;
+        cell_type chained{node.value};
+        for ( std::size_t d = 0; d < dim; ++d )
+        {
+            offset[d] = static_cast<int>(gen()%(2*range - 1)) - range + 1;
+            chained = (offset[d] < 0) ? chained.minus(static_cast<direction>(d), -offset[d])
+                                      : chained.plus(static_cast<direction>(d), offset[d]);
+        }
+        EXPECT_EQ( node.plus(offset), chained.value );
+    }
+}
+
+TYPED_TEST(CellTest, stencil)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using definition = typename TestFixture::definition;
+    using node_type = typename TestFixture::node_type;
+
+    static_assert(FaceStencil<dim>::size == 2*dim, "wrong number of face neighbors");
+    static_assert(CornerStencil<dim>::size == ipow(3, dim) - 1, "wrong number of corner neighbors");
+    static_assert(FaceEdgeStencil<3>::size == 18, "wrong number of face and edge neighbors");
+    static_assert(MaskStencil<dim, 1, 0b11>::size == 2, "wrong number of masked neighbors");
+
+    std::mt19937_64 gen(23);
+    for ( std::size_t i = 0; i < 200; ++i )
+    {
+        const std::size_t level = gen()%definition::nlevels;
+        node_type node{static_cast<value_type>((TestFixture::random_value(gen)&definition::AllOnes[level]) + (static_cast<value_type>(level) << definition::levelshift))};
+
+        EXPECT_EQ( (node.template plus<direction::x, 1>()), node.plus(direction::x, 1) );
+        EXPECT_EQ( (node.template minus<direction::x, 1>()), node.minus(direction::x, 1) );
+
+        std::array<value_type, CornerStencil<dim>::size> corner;
+        neighbors<CornerStencil<dim>>(node, corner);
+        for ( std::size_t j = 0; j < corner.size(); ++j )
+            EXPECT_EQ( corner[j], node.plus(stencil_offset<CornerStencil<dim>>(j)) );
+
+        std::array<value_type, StarStencil<dim, 2>::size> star;
+        neighbors<StarStencil<dim, 2>>(node, star);
+        for ( std::size_t j = 0; j < star.size(); ++j )
+            EXPECT_EQ( star[j], node.plus(stencil_offset<StarStencil<dim, 2>>(j)) );
+    }
+}
+
+TYPED_TEST(CellTest, ordering)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using definition = typename TestFixture::definition;
+    using cell_type = Cell<dim, value_type>;
+    using coords_type = typename cell_type::coords_type;
+
+    // consecutive cells along the Hilbert curve are face neighbors.
+    const std::size_t level = std::min<std::size_t>(2, definition::nlevels - 1);
+    const std::size_t n = std::size_t{2} << level;
+    std::vector<cell_type> cells;
+    for ( std::size_t i = 0; i < ipow(n, dim); ++i )
+    {
+        coords_type coords;
+        for ( std::size_t d = 0; d < dim; ++d )
+            coords[d] = static_cast<value_type>((i/ipow(n, d))%n);
+        cells.push_back(cell_type{cell_type::encode(coords, level)});
+    }
+    std::sort(cells.begin(), cells.end(), [](auto const& a, auto const& b){return less<HilbertOrder>(a, b);});
+    for ( std::size_t i = 1; i < cells.size(); ++i )
+    {
+        auto const c0 = cells[i-1].coordinates();
+        auto const c1 = cells[i].coordinates();
+        std::size_t distance = 0;
+        for ( std::size_t d = 0; d < dim; ++d )
+            distance += (c0[d] > c1[d]) ? c0[d] - c1[d]: c1[d] - c0[d];
+        EXPECT_EQ( distance, 1 );
+        EXPECT_EQ( HilbertOrder::value<dim>(HilbertOrder::key<dim>(cells[i].value)), cells[i].value );
+    }
+
+    // the children are given along the curve.
+    std::mt19937_64 gen(31);
+    for ( std::size_t i = 0; i < 100; ++i )
+    {
+        const std::size_t lev = gen()%(definition::nlevels - 1);
+        cell_type cell{static_cast<value_type>((TestFixture::random_value(gen)&definition::AllOnes[lev]) + (static_cast<value_type>(lev) << definition::levelshift))};
+
+        std::array<cell_type, definition::treetype> zchildren, hchildren;
+        std::array<value_type, definition::treetype> zbrothers, hbrothers;
+        refine(cell, zchildren);
+        refine<HilbertOrder>(cell, hchildren);
+        brothers(zchildren[0], zbrothers);
+        brothers<HilbertOrder>(hchildren[definition::treetype-1], hbrothers);
+        for ( std::size_t j = 0; j < definition::treetype; ++j )
+        {
+            EXPECT_EQ( zchildren[j].value, zbrothers[j] );
+            EXPECT_EQ( hchildren[j].value, hbrothers[j] );
+            EXPECT_EQ( father(hchildren[j]), cell.value );
+            if ( j > 0 )
+            {
+                EXPECT_TRUE( less<HilbertOrder>(hchildren[j-1], hchildren[j]) );
+            }
+            EXPECT_TRUE( less<HilbertOrder>(cell, hchildren[j]) );
+        }
+    }
+}
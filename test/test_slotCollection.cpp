@@ -1,249 +1,655 @@
 #include "gtest/gtest.h"
 #include <tuple>
+#include <random>
 #include <tree/slot/slotCollection.hpp>
-#include <tree/node/node.hpp>
-#include <tree/slot/cache.hpp>
-
+#include <tree/slot/concurrentSlotCollection.hpp>
+#include <tree/slot/fields.hpp>
+#include <tree/slot/mapped.hpp>
+#include <tree/slot/outofcore.hpp>
+#include <tree/slot/build.hpp>
+#include <tree/slot/index.hpp>
+
+#include <thread>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
 #include <utility>
 #include <vector>
 
+struct density
+{
+    using type = double;
+    static char const* name() { return "density"; }
+};
+
+struct flag
+{
+    using type = unsigned char;
+    static char const* name() { return "flag"; }
+};
+
 #define DIM_GROUP(T) std::tuple<std::integral_constant<std::size_t, 1>, T>, std::tuple<std::integral_constant<std::size_t, 2>, T>, std::tuple<std::integral_constant<std::size_t, 3>, T>
 
 template <typename T>
-struct SlotCollectionTest: public ::testing::Test { 
+struct SlotCollectionTest: public ::testing::Test {
     static const std::size_t dim = std::tuple_element<0, T>::type::value;
     using value_type = typename std::tuple_element<1, T>::type;
+
+    using collection_type = slotCollection<dim, value_type>;
+    using cell_type = typename collection_type::cell_type;
+    using definition = typename collection_type::definition;
+
+    //! n distinct cells at the finest level, in random order.
+    static std::vector<cell_type> random_cells(std::size_t n)
+    {
+        std::mt19937_64 gen(7);
+        const std::size_t level = definition::nlevels - 1;
+        std::vector<cell_type> cells;
+        for (std::size_t i = 0; cells.size() < n && i < 2*n; ++i)
+        {
+            typename cell_type::coords_type coords;
+            for (std::size_t d = 0; d < dim; ++d)
+                coords[d] = static_cast<value_type>(gen()%(std::size_t{2} << std::min<std::size_t>(level, 20)));
+            cell_type cell{cell_type::encode(coords, level)};
+            if (std::find(cells.cbegin(), cells.cend(), cell) == cells.cend())
+                cells.push_back(cell);
+        }
+        return cells;
+    }
+
+    //! the slots cover the domain and contain their cells.
+    static void check_slots(collection_type const& SC)
+    {
+        EXPECT_EQ( SC.s1(0), 0 );
+        for (std::size_t i = 0; i < SC.size(); ++i)
+        {
+            EXPECT_LT( SC.s1(i), SC.s2(i) );
+            EXPECT_LE( SC[i].size(), SC.slot_max_size );
+            if (SC.size() > 1)
+            {
+                EXPECT_GE( SC[i].size(), SC.slot_min_size );
+            }
+            for (auto const& cell : SC[i])
+            {
+                EXPECT_LE( SC.s1(i), cell.value&definition::maskpos );
+                EXPECT_GT( SC.s2(i), cell.value&definition::maskpos );
+                EXPECT_EQ( SC.findSlot(cell), i );
+                EXPECT_EQ( &SC.ubound(cell), &SC[i] );
+            }
+        }
+    }
 };
 
-typedef ::testing::Types<DIM_GROUP(unsigned short), DIM_GROUP(unsigned int), DIM_GROUP(std::size_t)> SlotCollectionTypes;
+typedef ::testing::Types<DIM_GROUP(unsigned short), DIM_GROUP(unsigned int), DIM_GROUP(std::size_t), DIM_GROUP(unsigned __int128)> SlotCollectionTypes;
 TYPED_TEST_CASE(SlotCollectionTest, SlotCollectionTypes);
 
 TYPED_TEST(SlotCollectionTest, constructor)
 {
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
 
-    slotCollection<dim, value_type> SC{2, 10, 10, 10};
+    collection_type SC{2, 10, 5, 10};
     EXPECT_EQ( SC.capacity(), 2 );
     EXPECT_EQ( SC.size(), 1 );
-    node_type n{1};
-    SC.insert(n);
-    EXPECT_EQ( SC[0]->capacity(), 10 );
-    EXPECT_EQ( SC[0]->size(), 1 );
-    // remark: we don't set capacity for slotCollection and slot in the copy constructor
-    slotCollection<dim, value_type> SCcopy{SC};
-    EXPECT_EQ( SCcopy.capacity(), 1 );
+    EXPECT_EQ( SC[0].capacity(), 10 );
+    EXPECT_EQ( SC[0].size(), 0 );
+    SC.insert(cell_type{1});
+    EXPECT_EQ( SC[0].size(), 1 );
+
+    collection_type SCcopy{SC};
     EXPECT_EQ( SCcopy.size(), 1 );
-    EXPECT_EQ( SCcopy[0]->capacity(), 1 );
-    EXPECT_EQ( SCcopy[0]->size(), 1 );
+    EXPECT_EQ( SCcopy[0].size(), 1 );
+    EXPECT_EQ( SCcopy.slot_min_size, 5 );
+    EXPECT_EQ( SCcopy.slot_max_size, 10 );
 }
 
-TYPED_TEST(SlotCollectionTest, clone)
+TYPED_TEST(SlotCollectionTest, swap)
 {
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
 
-    slotCollection<dim, value_type> SC{2, 10, 10, 10};
-    EXPECT_EQ( SC.capacity(), 2 );
-    EXPECT_EQ( SC.size(), 1 );
-    node_type n{1};
-    SC.insert(n);
-
-    slotCollection<dim, value_type> SCclone{};
-    SCclone.clone(SC);
-    EXPECT_EQ( SCclone.capacity(), 1 );
-    EXPECT_EQ( SCclone.size(), 1 );
-    EXPECT_EQ( SCclone[0]->capacity(), SC[0]->size()*node_type::treetype );
-    EXPECT_EQ( SCclone[0]->size(), 0 );
-}
+    collection_type SC1{2, 10, 5, 11};
+    collection_type SC2{10, 5, 3, 6};
+    SC1.insert(cell_type{1});
+    SC1.insert(cell_type{2});
+    SC2.insert(cell_type{1});
 
-TYPED_TEST(SlotCollectionTest, swap)
-{
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
-
-    slotCollection<dim, value_type> SC1{2, 10, 10, 11};
-    slotCollection<dim, value_type> SC2{10, 5, 5, 6};
-    node_type n1{1}, n2{2};
-    SC1.insert(n1);
-    SC1.insert(n2);
-    SC2.insert(n1);
-    
     std::swap(SC1, SC2);
-    EXPECT_EQ( SC1[0]->size(), 1 );
-    EXPECT_EQ( SC1.slot_min_size, 5 );
+    EXPECT_EQ( SC1[0].size(), 1 );
+    EXPECT_EQ( SC1.slot_min_size, 3 );
     EXPECT_EQ( SC1.slot_max_size, 6 );
 
-    EXPECT_EQ( SC2[0]->size(), 2 );
-    EXPECT_EQ( SC2.slot_min_size, 10 );
+    EXPECT_EQ( SC2[0].size(), 2 );
+    EXPECT_EQ( SC2.slot_min_size, 5 );
     EXPECT_EQ( SC2.slot_max_size, 11 );
 }
 
-TYPED_TEST(SlotCollectionTest, findSlot)
-{
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
-    using slot_type = slot<dim, value_type>;
-    
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    SC.push_back(std::make_shared<slot_type>(2, 4, 10));
-    SC[0]->s2 = 2;
-    node_type n1{1}, n2{3}, n3{5};
-    EXPECT_EQ(SC.findSlot(n1, 0, SC.size()-1), 0); 
-    EXPECT_EQ(SC.findSlot(n2, 0, SC.size()-1), 1); 
-}
-
-TYPED_TEST(SlotCollectionTest, ubound)
+TYPED_TEST(SlotCollectionTest, index)
 {
-    auto const dim = TestFixture::dim;
     using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
-    using slot_type = slot<dim, value_type>;
-    
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    SC.push_back(std::make_shared<slot_type>(10));
-    SC[0]->s2 = node_type::AllOnes[0];
-    SC[1]->s1 = node_type::AllOnes[0];
-    node_type n1{0}, n2{node_type::AllOnes[0] + (node_type::Xbit>>dim)};
-    n2.set_level(1);
-    EXPECT_EQ(SC.ubound(n1).get(), SC[0].get());
-    EXPECT_EQ(SC.ubound_hashed(n1.hash()).get(), SC[0].get());
-    EXPECT_EQ(SC.ubound(n2).get(), SC[1].get());
-    EXPECT_EQ(SC.ubound_hashed(n2.hash()).get(), SC[1].get()); 
-}
 
-TYPED_TEST(SlotCollectionTest, compress)
-{
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
-    using slot_type = slot<dim, value_type>;
-    
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    SC.push_back(std::make_shared<slot_type>(10));
-   
-    SC.compress();
+    std::mt19937_64 gen(3);
+    for (std::size_t n = 0; n < 70; ++n)
+    {
+        std::vector<value_type> bounds(n);
+        for (auto& b : bounds)
+            b = static_cast<value_type>(gen()%1000);
+        std::sort(bounds.begin(), bounds.end());
+
+        SlotIndex<value_type> index;
+        auto check = [&]
+        {
+            ASSERT_EQ( index.size(), bounds.size() );
+            for (std::size_t i = 0; i < bounds.size(); ++i)
+                EXPECT_EQ( index[i], bounds[i] );
+            for (value_type key = 0; key < 1001; key = static_cast<value_type>(key + 7))
+                EXPECT_EQ( index.upper_bound(key), std::upper_bound(bounds.cbegin(), bounds.cend(), key) - bounds.cbegin() );
+        };
+        index.assign(bounds.cbegin(), bounds.cend());
+        EXPECT_TRUE( index.upToDate() );
+        check();
+
+        // incremental update: searched in the sorted bounds, then rebuilt
+        if (n > 0)
+        {
+            const std::size_t rank = gen()%n;
+            index.erase(rank);
+            bounds.erase(bounds.begin() + rank);
+            index.insert(0, 0);
+            bounds.insert(bounds.begin(), 0);
+            EXPECT_FALSE( index.upToDate() );
+            check();
+            index.refresh();
+            EXPECT_TRUE( index.upToDate() );
+            check();
+        }
+
+        // the layout is rebuilt after n/8 + 8 changes
+        std::size_t changes = 0;
+        while (!index.upToDate() || changes == 0)
+        {
+            const value_type key = static_cast<value_type>(gen()%1000);
+            const std::size_t rank = std::upper_bound(bounds.cbegin(), bounds.cend(), key) - bounds.cbegin();
+            index.insert(rank, key);
+            bounds.insert(bounds.begin() + rank, key);
+            ++changes;
+            if (changes%3 == 0)
+                check();
+        }
+        EXPECT_EQ( changes, n/8 + 9 );
+        check();
+    }
 }
 
-TYPED_TEST(SlotCollectionTest, nbNodes)
+TYPED_TEST(SlotCollectionTest, split)
 {
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
-    using slot_type = slot<dim, value_type>;
-    
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    SC.push_back(std::make_shared<slot_type>(10));
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
 
-    const std::size_t N = 100;
-    EXPECT_EQ( SC.nbNodes(), 0 );
-    for ( std::size_t i = 0; i < N; ++i )
+    auto const cells = TestFixture::random_cells(500);
+    collection_type SC{1, 16, 4, 16};
+    for (std::size_t i = 0; i < cells.size(); ++i)
     {
-        SC.insert( node_type(i) );
+        SC.insert(cells[i]);
         EXPECT_EQ( SC.nbNodes(), i+1 );
     }
+    EXPECT_GT( SC.size(), cells.size()/16 );
+    EXPECT_LE( SC.maxSlotSize(), 16 );
+    TestFixture::check_slots(SC);
+
+    for (auto const& cell : cells)
+    {
+        EXPECT_EQ( SC.count(cell), 1 );
+        EXPECT_EQ( SC.count(cell_type{static_cast<typename TestFixture::value_type>(cell.value + TestFixture::definition::levelone)}), 0 );
+    }
 }
 
-TYPED_TEST(SlotCollectionTest, count)
+TYPED_TEST(SlotCollectionTest, merge)
 {
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
+    using collection_type = typename TestFixture::collection_type;
 
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    node_type n1{1}, n2{2}, n3{3};
-    SC.insert(n1);
-    SC.insert(n2);
-    
-    EXPECT_EQ( SC.count( n1 ), 1 );
-    EXPECT_EQ( SC.count( n2 ), 1 );
-    EXPECT_EQ( SC.count( n3 ), 0 );
-}
+    auto const cells = TestFixture::random_cells(500);
+    collection_type SC{1, 16, 4, 16};
+    for (auto const& cell : cells)
+        SC.insert(cell);
 
-TYPED_TEST(SlotCollectionTest, count_with_cache)
-{
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
-    using cache_type = Cache<dim, value_type>;
+    const std::size_t nslots = SC.size();
+    for (std::size_t i = 0; i < cells.size(); i += 2)
+        EXPECT_EQ( SC.erase(cells[i]), 1 );
+    EXPECT_EQ( SC.erase(cells[0]), 0 );
+    EXPECT_LT( SC.size(), nslots );
+    TestFixture::check_slots(SC);
 
-    cache_type cache{};
+    for (std::size_t i = 0; i < cells.size(); ++i)
+        EXPECT_EQ( SC.count(cells[i]), i%2 );
+
+    for (std::size_t i = 1; i < cells.size(); i += 2)
+        SC.erase(cells[i]);
+    EXPECT_EQ( SC.size(), 1 );
+    EXPECT_EQ( SC.nbNodes(), 0 );
+}
 
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    const node_type n1{1}, n2{2}, n3{3};
-    SC.insert(n1, cache);
-    SC.insert(n2, cache);
-    
-    EXPECT_EQ( SC.count( n1, cache ), 1 );
-    EXPECT_EQ( SC.count( n2, cache ), 1 );
-    EXPECT_EQ( SC.count( n3, cache ), 0 );
+TYPED_TEST(SlotCollectionTest, fromPacks)
+{
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
+
+    auto const cells = TestFixture::random_cells(300);
+    std::vector<typename cell_type::coords_type> points;
+    for (auto const& cell : cells)
+        points.push_back(cell.coordinates());
+    auto const leaves = buildLeaves(points, 1);
+
+    collection_type SC{split(leaves, 5), 8, 32};
+    EXPECT_EQ( SC.nbNodes(), leaves.size() );
+    TestFixture::check_slots(SC);
+    for (auto const& leaf : leaves)
+        EXPECT_EQ( SC.count(leaf), 1 );
+    EXPECT_EQ( flatten(SC.slots()).size(), leaves.size() );
 }
 
 TYPED_TEST(SlotCollectionTest, nbNodesByLevel)
 {
-    auto const dim = TestFixture::dim;
-    using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
-
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    node_type n1{1}; n1.set_level(0);
-    node_type n2{2}; n2.set_level(1);
-    node_type n3{3}; n3.set_level(1);
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
 
+    collection_type SC{2, 10, 5, 11};
+    cell_type n1{1}; n1.setLevel(0);
+    cell_type n2{2}; n2.setLevel(1);
+    cell_type n3{3}; n3.setLevel(1);
     SC.insert(n1);
     SC.insert(n2);
     SC.insert(n3);
-    
-    // TODO: adding node in different slots.
 
     const auto level_count = SC.nbNodesByLevel();
-
     EXPECT_EQ( level_count[0], 1 );
     EXPECT_EQ( level_count[1], 2 );
     EXPECT_EQ( level_count[2], 0 );
+    EXPECT_EQ( SC.maxSlotSize(), 3 );
+}
+
+TYPED_TEST(SlotCollectionTest, copyInArray)
+{
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
+
+    auto const cells = TestFixture::random_cells(100);
+    collection_type SC{1, 16, 4, 16};
+    for (auto const& cell : cells)
+        SC.insert(cell);
+
+    std::vector<cell_type> array(SC.nbNodes());
+    SC.copyInArray(array);
+    for (std::size_t i = 0; i < SC.size(); ++i)
+        for (std::size_t j = 0; j < SC[i].size(); ++j)
+            EXPECT_EQ( array[SC.startRank(i) + j].value, SC[i][j].value );
+}
+
+TYPED_TEST(SlotCollectionTest, compress)
+{
+    using collection_type = typename TestFixture::collection_type;
+    using definition = typename TestFixture::definition;
+
+    auto const cells = TestFixture::random_cells(200);
+    collection_type SC{1, 16, 4, 16};
+    for (auto const& cell : cells)
+        SC.insert(cell);
+
+    std::size_t removed = 0;
+    for (std::size_t i = 0; i < SC.size(); ++i)
+    {
+        for (std::size_t j = 0; j < SC[i].size(); j += 2, ++removed)
+            SC[i][j].setTags(definition::voidbit);
+        SC[i].setTags(definition::voidbit);
+    }
+    SC.compress();
+    EXPECT_EQ( SC.nbNodes(), cells.size() - removed );
+    TestFixture::check_slots(SC);
 }
 
-TYPED_TEST(SlotCollectionTest, maxSlotSize)
+TYPED_TEST(SlotCollectionTest, count_with_cache)
 {
-    auto const dim = TestFixture::dim;
+    constexpr auto dim = TestFixture::dim;
     using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
+    using collection_type = typename TestFixture::collection_type;
+    using cache_type = Cache<dim, value_type, 4>;
 
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    const node_type n1{1}, n2{2}, n3{3};
+    auto const cells = TestFixture::random_cells(300);
+    collection_type SC{1, 16, 4, 16};
+    cache_type cache{};
+    for (auto const& cell : cells)
+        SC.insert(cell, cache);
+    EXPECT_EQ( SC.nbNodes(), cells.size() );
+    TestFixture::check_slots(SC);
+
+    // the same slot is found again
+    cache.resetCounters();
+    for (std::size_t k = 0; k < 3; ++k)
+        for (auto const& cell : cells)
+        {
+            EXPECT_EQ( SC.count(cell, cache), 1 );
+            EXPECT_EQ( cache.slotRank(), SC.findSlot(cell) );
+            EXPECT_EQ( cache.getslot()[cache.rankInSlot()].value, cell.value );
+            EXPECT_EQ( SC.count(cell, cache), 1 );
+        }
+    EXPECT_EQ( cache.hits() + cache.misses(), 6*cells.size() );
+    EXPECT_GE( cache.hits(), 3*cells.size() );
+
+    SC.finalize();
+    SC.count(cells[0], cache);
+    EXPECT_EQ( cache.globalrank(SC), SC.startRank(cache.slotRank()) + cache.rankInSlot() );
+
+    // the cache is invalidated when the slots change
+    const auto epoch = SC.epoch();
+    for (std::size_t i = 0; i < cells.size(); i += 2)
+        EXPECT_EQ( SC.erase(cells[i], cache), 1 );
+    EXPECT_NE( SC.epoch(), epoch );
+    for (std::size_t i = 0; i < cells.size(); ++i)
+        EXPECT_EQ( SC.count(cells[i], cache), i%2 );
+
+    // or when an other collection is used
+    collection_type SCcopy{SC};
+    SCcopy.insert(cells[0]);
+    EXPECT_EQ( SCcopy.count(cells[0], cache), 1 );
+    EXPECT_EQ( &cache.getslot(), &SCcopy[SCcopy.findSlot(cells[0])] );
+    EXPECT_EQ( SC.count(cells[0], cache), 0 );
+}
 
-    SC.insert(n1);
-    SC.insert(n2);
-    SC.insert(n3);
-    
-    // TODO: adding node in different slots.
+TYPED_TEST(SlotCollectionTest, bulk_insert)
+{
+    using collection_type = typename TestFixture::collection_type;
+    using slot_type = typename collection_type::slot_type;
+
+    auto const cells = TestFixture::random_cells(3000);
+    const std::size_t nfirst = cells.size()/10;
+    collection_type SC{1, 16, 4, 16};
+    for (std::size_t i = 0; i < nfirst; ++i)
+        SC.insert(cells[i]);
+    const std::size_t nslots = SC.size();
+
+    SC.insert(slot_type{0, 0});
+    EXPECT_EQ( SC.size(), nslots );
+    EXPECT_EQ( SC.nbNodes(), nfirst );
+
+    // most of the slots receive many times slot_max_size cells
+    const auto epoch = SC.epoch();
+    slot_type batch{0, cells.size() - nfirst};
+    batch.insert(batch.end(), cells.cbegin() + nfirst, cells.cend());
+    SC.insert(batch);
+    EXPECT_NE( SC.epoch(), epoch );
+    EXPECT_EQ( SC.nbNodes(), cells.size() );
+    TestFixture::check_slots(SC);
+    for (auto const& cell : cells)
+        EXPECT_EQ( SC.count(cell), 1 );
+}
 
-    EXPECT_EQ( SC.maxSlotSize(), 3 );
+TYPED_TEST(SlotCollectionTest, concurrent_insert)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using collection_type = typename TestFixture::collection_type;
+
+    auto const cells = TestFixture::random_cells(4000);
+    const std::size_t nfirst = cells.size()/4;
+    collection_type SC{1, 64, 16, 64};
+    for (std::size_t i = 0; i < nfirst; ++i)
+        SC.insert(cells[i]);
+
+    // the slots are moved in the concurrent collection
+    concurrentSlotCollection<dim, value_type> CSC{SC};
+    EXPECT_EQ( SC.size(), 1 );
+    EXPECT_EQ( SC.nbNodes(), 0 );
+    EXPECT_EQ( CSC.nbNodes(), nfirst );
+
+    // threads inserting interleaved cells, to cut the same slots
+    const std::size_t nthreads = 4;
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < nthreads; ++t)
+        threads.emplace_back([&, t]
+        {
+            for (std::size_t i = nfirst + t; i < cells.size(); i += nthreads)
+            {
+                CSC.insert(cells[i]);
+                CSC.count(cells[i - nfirst]);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ( CSC.nbNodes(), cells.size() );
+    EXPECT_GT( CSC.nbSlots(), cells.size()/64 );
+    for (auto const& cell : cells)
+        EXPECT_EQ( CSC.count(cell), 1 );
+
+    SC = CSC.release();
+    EXPECT_EQ( CSC.nbSlots(), 1 );
+    EXPECT_EQ( CSC.nbNodes(), 0 );
+    EXPECT_EQ( SC.nbNodes(), cells.size() );
+    TestFixture::check_slots(SC);
+    for (auto const& cell : cells)
+        EXPECT_EQ( SC.count(cell), 1 );
 }
 
-TYPED_TEST(SlotCollectionTest, copyInArray)
+TYPED_TEST(SlotCollectionTest, fields)
 {
-    auto const dim = TestFixture::dim;
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
+    using definition = typename TestFixture::definition;
+    using fields_type = CellFields<collection_type, density, flag>;
+
+    auto const cells = TestFixture::random_cells(600);
+    auto value = [](cell_type const& cell){return static_cast<double>(cell.value&definition::maskpos);};
+    auto SC = std::make_unique<collection_type>(1, 16, 4, 16);
+    for (std::size_t i = 0; i < cells.size()/2; ++i)
+        SC->insert(cells[i]);
+
+    fields_type fields{*SC};
+    EXPECT_EQ( fields.size(), SC->nbNodes() );
+    EXPECT_EQ( fields.names()[0], std::string("density") );
+    EXPECT_EQ( fields.names()[1], std::string("flag") );
+    EXPECT_EQ( reinterpret_cast<std::uintptr_t>(fields.template data<density>())%64, 0 );
+    for (std::size_t i = 0; i < SC->size(); ++i)
+        for (std::size_t k = 0; k < (*SC)[i].size(); ++k)
+        {
+            fields.template at<density>(i, k) = value((*SC)[i][k]);
+            fields.template at<flag>(i, k) = 1;
+        }
+
+    // cells added and removed, slots cut and merged: the values follow
+    // their cells at finalize, the new cells have default values
+    for (std::size_t i = cells.size()/2; i < cells.size(); ++i)
+        SC->insert(cells[i]);
+    for (std::size_t i = 0; i < cells.size()/2; i += 3)
+        SC->erase(cells[i]);
+    (*SC)[0][0].setTags(definition::voidbit);
+    SC->finalize();
+    ASSERT_EQ( fields.size(), SC->nbNodes() );
+    for (std::size_t i = 0; i < SC->size(); ++i)
+        for (std::size_t k = 0; k < (*SC)[i].size(); ++k)
+        {
+            auto const& cell = (*SC)[i][k];
+            const bool old = std::find(cells.cbegin(), cells.cbegin() + cells.size()/2, cell_type{static_cast<typename TestFixture::value_type>(cell.value&definition::partWithoutFreeBits)})
+                             != cells.cbegin() + cells.size()/2;
+            EXPECT_EQ( fields.template at<flag>(i, k), old ? 1: 0 );
+            EXPECT_EQ( fields.template at<density>(i, k), old ? value(cell): 0. );
+        }
+
+    // a copy of the collection is not observed
+    collection_type copy{*SC};
+    copy.erase((*SC)[0][0]);
+    copy.finalize();
+    EXPECT_EQ( fields.size(), SC->nbNodes() );
+
+    // the fields can outlive the collection
+    SC.reset();
+}
+
+TYPED_TEST(SlotCollectionTest, mapped)
+{
+    constexpr auto dim = TestFixture::dim;
     using value_type = typename TestFixture::value_type;
-    using node_type = Node<dim, value_type>;
+    using collection_type = typename TestFixture::collection_type;
+    using definition = typename TestFixture::definition;
+    using fields_type = CellFields<collection_type, density, flag>;
+    using mapped_type = MappedCollection<dim, value_type>;
+
+    auto const cells = TestFixture::random_cells(500);
+    collection_type SC{1, 16, 4, 16};
+    for (std::size_t i = 0; i < cells.size()/2; ++i)
+        SC.insert(cells[i]);
+    fields_type fields{SC};
+    for (std::size_t i = 0; i < SC.size(); ++i)
+        for (std::size_t k = 0; k < SC[i].size(); ++k)
+        {
+            fields.template at<density>(i, k) = static_cast<double>(SC[i][k].value&definition::maskpos);
+            fields.template at<flag>(i, k) = static_cast<unsigned char>(k);
+        }
+
+    const std::string path = ::testing::TempDir() + "zcode_mapped_" + std::to_string(dim) + "_" + std::to_string(sizeof(value_type));
+    save(path, SC, fields);
+    {
+        mapped_type mapped{path};
+        ASSERT_EQ( mapped.size(), SC.size() );
+        ASSERT_EQ( mapped.nbNodes(), SC.nbNodes() );
+        EXPECT_EQ( reinterpret_cast<std::uintptr_t>(mapped.cells())%64, 0 );
+        double const* rho = mapped.template field<density>();
+        unsigned char const* flags = mapped.template field<flag>();
+        ASSERT_NE( rho, nullptr );
+        ASSERT_NE( flags, nullptr );
+        EXPECT_EQ( reinterpret_cast<std::uintptr_t>(rho)%64, 0 );
+        for (std::size_t i = 0; i < SC.size(); ++i)
+        {
+            EXPECT_EQ( mapped.s1(i), SC.s1(i) );
+            EXPECT_EQ( mapped.s2(i), SC.s2(i) );
+            EXPECT_EQ( mapped.startRank(i), SC.startRank(i) );
+            auto const slot = mapped[i];
+            EXPECT_EQ( slot.value, SC.s1(i) );
+            ASSERT_EQ( slot.size(), SC[i].size() );
+            for (std::size_t k = 0; k < slot.size(); ++k)
+            {
+                EXPECT_EQ( slot[k].value, SC[i][k].value );
+                EXPECT_EQ( rho[SC.startRank(i) + k], fields.template at<density>(i, k) );
+                EXPECT_EQ( flags[SC.startRank(i) + k], fields.template at<flag>(i, k) );
+            }
+        }
+        for (auto const& cell : cells)
+            EXPECT_EQ( mapped.count(cell), SC.count(cell) );
+
+        auto loaded = mapped.load();
+        EXPECT_EQ( loaded.size(), SC.size() );
+        EXPECT_EQ( loaded.nbNodes(), SC.nbNodes() );
+        TestFixture::check_slots(loaded);
+        for (auto const& cell : cells)
+            EXPECT_EQ( loaded.count(cell), SC.count(cell) );
+    }
 
-    slotCollection<dim, value_type> SC{2, 10, 10, 11};
-    const node_type n1{1}, n2{2}, n3{3};
+    // the file without the fields (rewritten once unmapped, for Windows)
+    save(path, SC);
+    {
+        mapped_type without{path};
+        EXPECT_EQ( without.template field<density>(), nullptr );
+        EXPECT_EQ( without.nbNodes(), SC.nbNodes() );
+    }
 
-    SC.insert(n1);
-    SC.insert(n2);
-    SC.insert(n3);
-    
-    // TODO: adding node in different slots.
-    
-    std::vector<node_type> array( 3 );
-    SC.copyInArray( array );
-
-    EXPECT_EQ( array[0], n1.hash() );
-    EXPECT_EQ( array[1], n2.hash() );
-    EXPECT_EQ( array[2], n3.hash() );
+    // truncated or of another type
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file.put(0);
+    }
+    EXPECT_THROW( mapped_type{path}, std::runtime_error );
+    save(path, SC);
+    EXPECT_THROW( (MappedCollection<dim == 3 ? 1: dim + 1, value_type>{path}), std::runtime_error );
+
+    // corrupted slots, or sizes overflowing the extents
+    mapped_header header;
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    }
+    auto corrupt = [&](std::uint64_t offset, auto value)
+    {
+        save(path, SC);
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(reinterpret_cast<char const*>(&value), sizeof(value));
+    };
+    corrupt(header.ranks_offset, std::uint64_t{1});
+    EXPECT_THROW( mapped_type{path}, std::runtime_error );
+    corrupt(header.bounds_offset, value_type{1});
+    EXPECT_THROW( mapped_type{path}, std::runtime_error );
+    corrupt(offsetof(mapped_header, nslots), std::uint64_t{1} << 63);
+    EXPECT_THROW( mapped_type{path}, std::runtime_error );
+    if (SC.size() > 2)
+    {
+        corrupt(header.ranks_offset + sizeof(std::uint64_t), std::uint64_t{header.ncells + 1});
+        EXPECT_THROW( mapped_type{path}, std::runtime_error );
+        corrupt(header.bounds_offset + sizeof(value_type), value_type{0});
+        EXPECT_THROW( mapped_type{path}, std::runtime_error );
+    }
+
+    std::remove(path.c_str());
+    EXPECT_THROW( mapped_type{path}, std::runtime_error );
+}
+
+TYPED_TEST(SlotCollectionTest, outOfCore)
+{
+    constexpr auto dim = TestFixture::dim;
+    using value_type = typename TestFixture::value_type;
+    using collection_type = typename TestFixture::collection_type;
+    using cell_type = typename TestFixture::cell_type;
+    using ooc_type = OutOfCoreCollection<dim, value_type>;
+
+    auto const cells = TestFixture::random_cells(3000);
+    collection_type SC{1, 64, 16, 64};
+    for (std::size_t i = 0; i < cells.size()/2; ++i)
+        SC.insert(cells[i]);
+    SC.finalize();
+
+    // on tmpfs when there is one
+    const std::string dir = std::ifstream("/dev/shm/.").good() ? std::string("/dev/shm/"): ::testing::TempDir();
+    const std::string path = dir + "zcode_ooc_" + std::to_string(dim) + "_" + std::to_string(sizeof(value_type));
+    save(path, SC);
+
+    const std::size_t budget = 4*SC.slot_max_size*sizeof(cell_type);
+    const std::size_t max_bytes = std::max(budget, SC.maxSlotSize()*sizeof(cell_type));
+    {
+        ooc_type ooc{path, budget, 2};
+        ASSERT_EQ( ooc.size(), SC.size() );
+        ASSERT_EQ( ooc.nbNodes(), SC.nbNodes() );
+        EXPECT_EQ( ooc.residentBytes(), 0 );
+
+        // a traversal prefetches and evicts
+        for (std::size_t i = 0; i < ooc.size(); ++i)
+        {
+            auto const& slot = ooc[i];
+            EXPECT_EQ( slot.value, SC.s1(i) );
+            ASSERT_EQ( slot.size(), SC[i].size() );
+            for (std::size_t k = 0; k < slot.size(); ++k)
+                EXPECT_EQ( slot[k].value, SC[i][k].value );
+            EXPECT_LE( ooc.residentBytes(), max_bytes );
+        }
+        if (SC.size() > 8)
+        {
+            EXPECT_GT( ooc.nbPrefetches(), 0 );
+            EXPECT_GT( ooc.nbEvictions(), 0 );
+            EXPECT_LT( ooc.nbLoads(), SC.size() );
+        }
+
+        // lookups through a cache
+        typename ooc_type::template cache_type<4> cache;
+        for (auto const& cell : cells)
+        {
+            EXPECT_EQ( ooc.count(cell, cache), SC.count(cell) );
+            EXPECT_EQ( ooc.count(cell), SC.count(cell) );
+            EXPECT_LE( ooc.residentBytes(), max_bytes );
+        }
+        EXPECT_GT( cache.hits(), 0 );
+
+        ooc.evictAll();
+        EXPECT_EQ( ooc.residentBytes(), 0 );
+        EXPECT_EQ( ooc.nbResident(), 0 );
+        EXPECT_EQ( ooc.load().nbNodes(), SC.nbNodes() );
+    }
+    std::remove(path.c_str());
 }